@@ -7,75 +7,190 @@
 #include <map>
 #include <time.h>
 
+#include <cmath>
+#include <boost/cstdint.hpp>
+#include <boost/static_assert.hpp>
 #include <graphlab.hpp>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-//helper function
-float myrand() {
-	return static_cast<float>(rand() / (RAND_MAX + 1.0));
-}
+//sketch used for the neighbourhood counts, -DAP_SKETCH=SKETCH_FM to change
+#define SKETCH_FM 0
+#define SKETCH_HLL 1
+#ifndef AP_SKETCH
+#define AP_SKETCH SKETCH_HLL
+#endif
 
-//helper function to return a hash value for Flajolet & Martin bitmask
-size_t hash_value() {
-	size_t ret = 0;
-	while (myrand() < 0.5) {
-		ret++;
-	}
-	return ret;
-}
+//fraction of reachable pairs that defines the effective diameter
+double EFFECTIVE_QUANTILE = 0.9;
 
-const size_t DUPULICATION_OF_BITMASKS = 10;
-//helper function to compute bitwise-or
-void bitwise_or(std::vector<int>& v1, const std::vector<int>& v2) {
-	for (size_t a = 0; a < v1.size(); ++a) {
-		v1[a] |= v2[a];
-	}
+//run all hops in one engine execution; only vertices whose sketch
+//changed in the previous hop send it on
+bool FRONTIER_HOPS = true;
+size_t MAX_HOPS = 0;
+float TERMINATION_CRITERIA = 0.0001;
+//neighbourhood function N(0), N(1), ... and stop flag, updated by the
+//aggregator on every machine
+std::vector<double> NEIGHBOURHOOD;
+size_t DIAMETER = 0;
+bool STOP = false;
+
+//helper function to hash a vertex id (splitmix64 finalizer): the same
+//graph always gets the same sketches, without any shared RNG state
+inline boost::uint64_t hash_value(boost::uint64_t id, boost::uint64_t seed) {
+	boost::uint64_t x = id + (seed + 1) * 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
 }
 
-struct vdata {
-	//use two bitmasks for consistency
-	std::vector<int> bitmask;
+//number of Flajolet & Martin bitmasks per vertex, -DFM_REGISTERS=n to change
+#ifndef FM_REGISTERS
+#define FM_REGISTERS 10
+#endif
+const size_t DUPULICATION_OF_BITMASKS = FM_REGISTERS;
+//registers are padded to whole 128-bit words; the padding stays zero
+const size_t FM_WORDS = (DUPULICATION_OF_BITMASKS + 3) / 4 * 4;
 
-	//indicate which is the bitmask for reading (or writing)
+//fixed-size sketch: lives inline in vertex data and messages and is
+//written to the archives as one block with vdata and one_hop
+struct __attribute__((aligned(16))) fm_sketch {
+	boost::uint32_t reg[FM_WORDS];
 
-	vdata() :
-			bitmask() {
+	fm_sketch() {
+		std::fill(reg, reg + FM_WORDS, 0);
 	}
-	explicit vdata(const std::vector<int> & others) :
-			bitmask() {
-		bitmask.clear();
-		for (size_t i = 0; i < others.size(); ++i) {
-			bitmask.push_back(others[i]);
+	//bitwise-or of all registers, four at a time
+	void merge(const fm_sketch& other) {
+#ifdef __SSE2__
+		for (size_t a = 0; a < FM_WORDS; a += 4) {
+			__m128i* dst = reinterpret_cast<__m128i*>(reg + a);
+			const __m128i src = _mm_load_si128(
+					reinterpret_cast<const __m128i*>(other.reg + a));
+			_mm_store_si128(dst, _mm_or_si128(_mm_load_si128(dst), src));
+		}
+#else
+		for (size_t a = 0; a < FM_WORDS; ++a) {
+			reg[a] |= other.reg[a];
 		}
+#endif
 	}
-	vdata& operator+=(const vdata& other) {
-		bitwise_or(bitmask, other.bitmask);
-		return *this;
+	bool operator==(const fm_sketch& other) const {
+		return std::equal(reg, reg + FM_WORDS, other.reg);
 	}
-	//for approximate Flajolet & Martin counting
-	void create_hashed_bitmask(size_t id) {
-		for (size_t i = 0; i < DUPULICATION_OF_BITMASKS; ++i) {
-			size_t hash_val = hash_value();
-			bitmask.push_back(1 << hash_val);
+	//one bit per register, set with probability 2^-(i+1) at position i
+	void init(graphlab::vertex_id_type id) {
+		for (size_t a = 0; a < DUPULICATION_OF_BITMASKS; ++a) {
+			const boost::uint64_t h = hash_value(id, a);
+			const size_t hash_val = h == 0 ? 31 : std::min<size_t>(__builtin_ctzll(h), 31);
+			reg[a] = boost::uint32_t(1) << hash_val;
 		}
 	}
-
-	void save(graphlab::oarchive& oarc) const {
-		size_t num = bitmask.size();
-		oarc << num;
-		for (size_t a = 0; a < num; ++a) {
-			oarc << bitmask[a];
+	//sum over the registers of the position of the lowest zero bit
+	size_t sum_first_zero() const {
+		size_t sum = 0;
+		for (size_t a = 0; a < DUPULICATION_OF_BITMASKS; ++a) {
+			const boost::uint32_t zeros = ~reg[a];
+			sum += zeros == 0 ? 32 : __builtin_ctz(zeros);
 		}
+		return sum;
+	}
+	double estimate() const {
+		const double sum = (double) sum_first_zero();
+		return pow(2.0, sum / (double) DUPULICATION_OF_BITMASKS) / 0.77351;
 	}
-	void load(graphlab::iarchive& iarc) {
-		bitmask.clear();
-		size_t num = 0;
-		iarc >> num;
-		for (size_t a = 0; a < num; ++a) {
-			int elem;
-			iarc >> elem;
-			bitmask.push_back(elem);
+};
+
+//number of HyperLogLog registers is 2^HLL_LOG2M, -DHLL_LOG2M=n to change;
+//the relative standard error is about 1.04 / sqrt(2^HLL_LOG2M)
+#ifndef HLL_LOG2M
+#define HLL_LOG2M 5
+#endif
+const size_t HLL_REGISTERS = size_t(1) << HLL_LOG2M;
+//one byte per register, eight registers per word
+const size_t HLL_WORDS = HLL_REGISTERS / 8;
+BOOST_STATIC_ASSERT(HLL_LOG2M >= 4 && HLL_LOG2M <= 16);
 
+//HyperLogLog counter: every register holds the largest rank (position of
+//the leading one bit) of the hashes that were routed to it
+struct __attribute__((aligned(16))) hll_sketch {
+	boost::uint64_t reg[HLL_WORDS];
+
+	hll_sketch() {
+		std::fill(reg, reg + HLL_WORDS, 0);
+	}
+	void init(graphlab::vertex_id_type id) {
+		const boost::uint64_t h = hash_value(id, 0);
+		const size_t index = h >> (64 - HLL_LOG2M);
+		const boost::uint64_t rest = h << HLL_LOG2M;
+		const boost::uint64_t rank = rest == 0 ? 64 - HLL_LOG2M + 1 : __builtin_clzll(rest) + 1;
+		reg[index / 8] |= rank << (8 * (index % 8));
+	}
+	//register-wise max, eight registers per word: ranks stay below 128,
+	//so (a | 0x80) - b keeps the high bit of every byte where a >= b
+	//and never borrows across bytes
+	void merge(const hll_sketch& other) {
+		const boost::uint64_t HIGH = 0x8080808080808080ULL;
+		for (size_t a = 0; a < HLL_WORDS; ++a) {
+			const boost::uint64_t x = reg[a], y = other.reg[a];
+			const boost::uint64_t ge = (((x | HIGH) - y) & HIGH) >> 7;
+			const boost::uint64_t mask = ge * 0xFF;
+			reg[a] = (x & mask) | (y & ~mask);
+		}
+	}
+	bool operator==(const hll_sketch& other) const {
+		return std::equal(reg, reg + HLL_WORDS, other.reg);
+	}
+	size_t get(size_t index) const {
+		return (reg[index / 8] >> (8 * (index % 8))) & 0xFF;
+	}
+	double estimate() const {
+		const double m = (double) HLL_REGISTERS;
+		double alpha = 0.7213 / (1.0 + 1.079 / m);
+		if (HLL_REGISTERS == 16)
+			alpha = 0.673;
+		else if (HLL_REGISTERS == 32)
+			alpha = 0.697;
+		else if (HLL_REGISTERS == 64)
+			alpha = 0.709;
+		double sum = 0.0;
+		size_t zeros = 0;
+		for (size_t i = 0; i < HLL_REGISTERS; ++i) {
+			const size_t r = get(i);
+			sum += ldexp(1.0, -(int) r);
+			zeros += r == 0;
 		}
+		const double e = alpha * m * m / sum;
+		//linear counting while many registers are still empty
+		if (e <= 2.5 * m && zeros > 0)
+			return m * log(m / (double) zeros);
+		return e;
+	}
+};
+
+#if AP_SKETCH == SKETCH_HLL
+typedef hll_sketch sketch_type;
+#else
+typedef fm_sketch sketch_type;
+#endif
+
+struct vdata: graphlab::IS_POD_TYPE {
+	sketch_type bitmask;
+
+	vdata() :
+			bitmask() {
+	}
+	explicit vdata(const sketch_type& others) :
+			bitmask(others) {
+	}
+	vdata& operator+=(const vdata& other) {
+		bitmask.merge(other.bitmask);
+		return *this;
+	}
+	//for approximate Flajolet & Martin or HyperLogLog counting
+	void create_hashed_bitmask(size_t id) {
+		bitmask.init(id);
 	}
 };
 
@@ -89,27 +204,9 @@ void initialize_vertex_with_hash(graph_type::vertex_type& v) {
 //The next bitmask b(h + 1; i) of i at the hop h + 1 is given as:
 //b(h + 1; i) = b(h; i) BITWISE-OR {b(h; k) | source = i & target = k}.
 class one_hop: public graphlab::ivertex_program<graph_type, graphlab::empty,
-		vdata> {
+		vdata>, public graphlab::IS_POD_TYPE {
 public:
-	std::vector<int> bitmask;
-	void save(graphlab::oarchive& oarc) const {
-		size_t num = bitmask.size();
-		oarc << num;
-		for (size_t a = 0; a < num; ++a) {
-			oarc << bitmask[a];
-		}
-	}
-	void load(graphlab::iarchive& iarc) {
-		bitmask.clear();
-		size_t num = 0;
-		iarc >> num;
-		for (size_t a = 0; a < num; ++a) {
-			int elem;
-			iarc >> elem;
-			bitmask.push_back(elem);
-
-		}
-	}
+	sketch_type bitmask;
 	void init(icontext_type& context, const vertex_type& vertex,
 			const vdata& msg) {
 		bitmask = msg.bitmask;
@@ -125,7 +222,7 @@ public:
 			const graphlab::empty& empty) {
 		if(context.iteration() == 1)
 		{
-			bitwise_or(vertex.data().bitmask, bitmask);
+			vertex.data().bitmask.merge(bitmask);
 		}
 	}
 
@@ -149,32 +246,98 @@ public:
 	}
 };
 
-//count the number of vertices reached in the current hop with Flajolet & Martin counting method
-size_t approximate_pair_number(std::vector<int> bitmask) {
-	float sum = 0.0;
-	for (size_t a = 0; a < bitmask.size(); ++a) {
-		for (size_t i = 0; i < 32; ++i) {
-			if ((bitmask[a] & (1 << i)) == 0) {
-				sum += (float) i;
-				break;
-			}
-		}
-	}
-	return (size_t) (pow(2.0, sum / (float) (bitmask.size())) / 0.77351);
+//count the number of vertices reached in the current hop with the sketch's counting method
+double approximate_pair_number(const sketch_type& bitmask) {
+	return bitmask.estimate();
 }
 //count the number of notes reached in the current hop
-size_t absolute_vertex_data_with_hash(const graph_type::vertex_type& vertex) {
-	size_t count = approximate_pair_number(vertex.data().bitmask);
+double absolute_vertex_data_with_hash(const graph_type::vertex_type& vertex) {
+	double count = approximate_pair_number(vertex.data().bitmask);
 	return count;
 }
 
+//smallest (interpolated) hop count within which EFFECTIVE_QUANTILE of all
+//reachable pairs are reached, from the neighbourhood function N(0), N(1), ...
+double effective_diameter(const std::vector<double>& neighbourhood) {
+	const double target = EFFECTIVE_QUANTILE * neighbourhood.back();
+	for (size_t h = 0; h < neighbourhood.size(); ++h) {
+		if (neighbourhood[h] >= target) {
+			if (h == 0)
+				return 0.0;
+			const double step = neighbourhood[h] - neighbourhood[h - 1];
+			return (double) (h - 1) + (target - neighbourhood[h - 1]) / step;
+		}
+	}
+	return (double) (neighbourhood.size() - 1);
+}
+
+//the same hop as one_hop, but the sketches travel only along out edges of
+//vertices whose sketch grew, so hop h + 1 starts from the frontier of hop h
+class frontier_hop: public graphlab::ivertex_program<graph_type, graphlab::empty,
+		vdata>, public graphlab::IS_POD_TYPE {
+	sketch_type bitmask;
+	bool changed;
+public:
+	void init(icontext_type& context, const vertex_type& vertex,
+			const vdata& msg) {
+		bitmask = msg.bitmask;
+	}
+	edge_dir_type gather_edges(icontext_type& context,
+			const vertex_type& vertex) const {
+		return graphlab::NO_EDGES;
+	}
+	void apply(icontext_type& context, vertex_type& vertex,
+			const graphlab::empty& empty) {
+		if (context.iteration() == 0) {
+			changed = true;
+		} else {
+			const sketch_type previous = vertex.data().bitmask;
+			vertex.data().bitmask.merge(bitmask);
+			changed = !(vertex.data().bitmask == previous);
+		}
+		if (STOP || context.iteration() >= MAX_HOPS) {
+			changed = false;
+		}
+	}
+	edge_dir_type scatter_edges(icontext_type& context,
+			const vertex_type& vertex) const {
+		if (changed) {
+			return graphlab::OUT_EDGES;
+		} else {
+			return graphlab::NO_EDGES;
+		}
+	}
+	void scatter(icontext_type& context, const vertex_type& vertex,
+			edge_type& edge) const {
+		context.signal(edge.target(), vdata(vertex.data().bitmask));
+	}
+};
+
+double hop_count(frontier_hop::icontext_type& context,
+		const graph_type::vertex_type& vertex) {
+	return absolute_vertex_data_with_hash(vertex);
+}
+
+//runs on every machine after each superstep: N(h) for h = superstep
+void record_hop(frontier_hop::icontext_type& context, const double& count) {
+	const size_t hop = context.iteration();
+	NEIGHBOURHOOD.resize(hop + 1);
+	NEIGHBOURHOOD[hop] = count;
+	if (hop > 0 && !STOP) {
+		context.cout() << hop << "-th hop: " << (size_t) count << " vertex pairs are reached\n";
+		if (count < NEIGHBOURHOOD[hop - 1] * (1.0 + TERMINATION_CRITERIA)) {
+			DIAMETER = hop - 1;
+			STOP = true;
+			context.cout() << "converge\n";
+		}
+	}
+}
+
 int main(int argc, char** argv) {
 
 	graphlab::mpi_tools::init(argc, argv);
 	graphlab::distributed_control dc;
 
-	float termination_criteria = 0.0001;
-
 	std::string graph_dir = argv[1];
 	std::string format = "adj";
 	bool use_sketch = true;
@@ -192,28 +355,54 @@ int main(int argc, char** argv) {
 	graph.transform_vertices(initialize_vertex_with_hash);
 	dc.cout() << "Loading graph in " << t.current_time() << " seconds"
 			<< std::endl;
-	graphlab::omni_engine<one_hop> engine(dc, graph, exec_type);
 	t.start();
-	//main iteration
-	size_t previous_count = 0;
-	size_t diameter = 0;
-	for (size_t iter = 0; iter < round; ++iter) {
+	if (FRONTIER_HOPS) {
+		MAX_HOPS = round;
+		graphlab::omni_engine<frontier_hop> engine(dc, graph, exec_type);
+		engine.add_vertex_aggregator<double>("hop", hop_count, record_hop);
+		// an interval of 0 runs the aggregator after every superstep
+		engine.aggregate_periodic("hop", 0);
 		engine.signal_all();
 		engine.start();
+		// the last superstep may have grown sketches after the final aggregation
+		const double final_count = graph.map_reduce_vertices<double>(absolute_vertex_data_with_hash);
+		if (NEIGHBOURHOOD.empty() || final_count != NEIGHBOURHOOD.back()) {
+			NEIGHBOURHOOD.push_back(final_count);
+		}
+		if (!STOP) {
+			DIAMETER = NEIGHBOURHOOD.size() - 1;
+		}
+	} else {
+		graphlab::omni_engine<one_hop> engine(dc, graph, exec_type);
+		//main iteration
+		NEIGHBOURHOOD.push_back(graph.map_reduce_vertices<double>(absolute_vertex_data_with_hash));
+		double previous_count = NEIGHBOURHOOD.back();
+		for (size_t iter = 0; iter < round; ++iter) {
+			engine.signal_all();
+			engine.start();
 
-		size_t current_count = 0;
-		current_count = graph.map_reduce_vertices<size_t>(absolute_vertex_data_with_hash);
-		dc.cout() << iter + 1 << "-th hop: " << current_count << " vertex pairs are reached\n";
-		if (iter > 0 && (float) current_count < (float) previous_count * (1.0 + termination_criteria)) {
-			diameter = iter;
-			dc.cout() << "converge\n";
-			//break;
+			double current_count = 0;
+			current_count = graph.map_reduce_vertices<double>(absolute_vertex_data_with_hash);
+			NEIGHBOURHOOD.push_back(current_count);
+			dc.cout() << iter + 1 << "-th hop: " << (size_t) current_count << " vertex pairs are reached\n";
+			if (iter > 0 && (float) current_count < (float) previous_count * (1.0 + TERMINATION_CRITERIA)) {
+				DIAMETER = iter;
+				dc.cout() << "converge\n";
+				//break;
+			}
+			previous_count = current_count;
 		}
-		previous_count = current_count;
 	}
  	
 	dc.cout() << graph_dir << "\n";
-	dc.cout() << "The approximate diameter is " << diameter << "\n";
+	dc.cout() << "The approximate diameter is " << DIAMETER << "\n";
+	dc.cout() << "Neighbourhood function:";
+	for (size_t h = 0; h < NEIGHBOURHOOD.size(); ++h) {
+		dc.cout() << " " << (size_t) NEIGHBOURHOOD[h];
+	}
+	dc.cout() << "\n";
+	dc.cout() << "The effective diameter (" << EFFECTIVE_QUANTILE << ") is "
+			<< effective_diameter(NEIGHBOURHOOD) << "\n";
 
 	dc.cout() << "Finished Running engine in " <<  t.current_time()<< " seconds." << std::endl;
 	graphlab::mpi_tools::finalize();
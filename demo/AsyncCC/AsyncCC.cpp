@@ -3,9 +3,23 @@
 #include <fstream>
 
 #include <graphlab.hpp>
+#include "../local_union_find.hpp"
 
 typedef int color_type;
 
+// start from the local union-find labels of every machine instead of the ids
+bool PRECONTRACT = true;
+std::vector<graphlab::vertex_id_type> LOCAL_LABELS;
+
+// gather from the opposite endpoint of every edge and signal only the
+// neighbours whose label is larger than the new one; false keeps the
+// original program, without PRECONTRACT, for comparison
+bool OPPOSITE_ENDPOINT = true;
+// count gathered edges and signals, reported at the end of the run
+bool COUNT_EDGE_WORK = false;
+graphlab::atomic<size_t> EDGE_READS;
+graphlab::atomic<size_t> SIGNALS;
+
 struct vertex_data: graphlab::IS_POD_TYPE {
 	color_type color;
 	vertex_data(color_type color = std::numeric_limits<color_type>::max()) :
@@ -40,7 +54,13 @@ public:
 	}
 	min_color_type gather(icontext_type& context, const vertex_type& vertex,
 			edge_type& edge) const {
-		return min_color_type(edge.source().data().color);
+		if (COUNT_EDGE_WORK)
+			EDGE_READS.inc();
+		if (!OPPOSITE_ENDPOINT)
+			return min_color_type(edge.source().data().color);
+		const vertex_type other = edge.source().id() == vertex.id() ?
+				edge.target() : edge.source();
+		return min_color_type(other.data().color);
 	}
 
 	void apply(icontext_type& context, vertex_type& vertex,
@@ -66,7 +86,19 @@ public:
 	 */
 	void scatter(icontext_type& context, const vertex_type& vertex,
 			edge_type& edge) const {
-		const vertex_type other = edge.target();
+		if (!OPPOSITE_ENDPOINT) {
+			if (COUNT_EDGE_WORK)
+				SIGNALS.inc();
+			context.signal(edge.target());
+			return;
+		}
+		const vertex_type other = edge.source().id() == vertex.id() ?
+				edge.target() : edge.source();
+		// a neighbour at or below our label would not change
+		if (other.data().color <= vertex.data().color)
+			return;
+		if (COUNT_EDGE_WORK)
+			SIGNALS.inc();
 		context.signal(other);
 	}
 
@@ -106,6 +138,8 @@ bool line_parser(graph_type& graph, const std::string& filename,
 
 void init_vertex(graph_type::vertex_type& vertex) { vertex.data().color = vertex.id(); }
 
+void init_local_label(graph_type::vertex_type& vertex) { vertex.data().color = LOCAL_LABELS[vertex.local_id()]; }
+
 int main(int argc, char** argv) {
 	graphlab::mpi_tools::init(argc, argv);
 
@@ -121,7 +155,12 @@ int main(int argc, char** argv) {
 	graph_type graph(dc);
 	graph.load(input_file, line_parser);
 	graph.finalize();
-    graph.transform_vertices(init_vertex);
+    if (PRECONTRACT && OPPOSITE_ENDPOINT) {
+        LOCAL_LABELS = local_component_labels(graph);
+        graph.transform_vertices(init_local_label);
+    } else {
+        graph.transform_vertices(init_vertex);
+    }
 
 	dc.cout() << "Loading graph in " << t.current_time() << " seconds"
 			<< std::endl;
@@ -134,6 +173,15 @@ int main(int argc, char** argv) {
 	dc.cout() << "Finished Running engine in " << engine.elapsed_seconds()
 			<< " seconds." << std::endl;
 
+	if (COUNT_EDGE_WORK) {
+		size_t edge_reads = EDGE_READS.value;
+		size_t signals = SIGNALS.value;
+		dc.all_reduce(edge_reads);
+		dc.all_reduce(signals);
+		dc.cout() << edge_reads << " edge reads, " << signals << " signals"
+				<< std::endl;
+	}
+
 	t.start();
 
 	graph.save(output_file, cc_writer(), false, // set to true if each output file is to be gzipped
@@ -1,21 +1,20 @@
 #include <vector>
 #include <string>
 #include <fstream>
-#include <boost/unordered_set.hpp>
+#include <limits>
+#include <algorithm>
 #include <graphlab.hpp>
 
 struct vertex_data: graphlab::IS_POD_TYPE
 {
     int left;
     int matchTo;
-    int lastMatchTo;
     vertex_data()
     {
         matchTo = -1;
-        lastMatchTo = -1;
     }
     vertex_data(int left, int matchTo = -1) :
-            left(left), matchTo(matchTo), lastMatchTo(-1)
+            left(left), matchTo(matchTo)
     {}
 }
 ;
@@ -23,73 +22,53 @@ struct vertex_data: graphlab::IS_POD_TYPE
 typedef graphlab::empty edge_data;
 typedef graphlab::distributed_graph<vertex_data, edge_data> graph_type;
 
-struct set_union_gather
+/*
+ * All matching rounds run in one engine execution, four supersteps per
+ * round: request, grant, accept, confirm. Only unmatched vertices take
+ * part; a rejected left vertex signals itself through the confirm step
+ * into the next round, everything else is woken by messages. A round
+ * with any request matches at least the smallest granted left vertex,
+ * and a rejection means its right vertex granted someone else, so the
+ * engine drains by itself once no request is sent.
+ */
+// pairs confirmed on this machine
+graphlab::atomic<size_t> MATCHES;
+
+const int NO_ID = std::numeric_limits<int>::max();
+
+/*
+ * Every phase needs only one id out of its messages: the smallest
+ * requester (phase 1), the smallest grant (phase 2) or the single
+ * acceptance (phase 3). Combining keeps the minimum id and ORs the
+ * reject flag, so messages stay fixed-size and never allocate.
+ */
+struct bmm_message: graphlab::IS_POD_TYPE
 {
-    boost::unordered_set<int> msgs;
-    set_union_gather()
+    int id;
+    bool rejected;
+    bmm_message(int id = NO_ID, bool rejected = false) :
+            id(id), rejected(rejected)
     {}
-    set_union_gather(int value)
+    bmm_message& operator+=(const bmm_message& other)
     {
-        msgs.insert(value);
-    }
-    set_union_gather& operator+=(const set_union_gather& other)
-    {
-        for(boost::unordered_set<int>::iterator it = other.msgs.begin() ; it != other.msgs.end() ; it++)
-        {
-            msgs.insert(*it);
-        }
+        id = std::min(id, other.id);
+        rejected = rejected || other.rejected;
         return *this;
     }
-
-    // serialize
-    void save(graphlab::oarchive& oarc) const
-    {
-        oarc << msgs;
-    }
-
-    // deserialize
-    void load(graphlab::iarchive& iarc)
-    {
-        iarc >> msgs;
-    }
 };
 
-int minValue(const boost::unordered_set<int> & msgs)
-{
-    int min = std::numeric_limits<int>::max();
-    for (boost::unordered_set<int>::const_iterator it = msgs.begin();
-            it != msgs.end(); it++)
-    {
-        min = std::min(min, *it);
-    }
-    return min;
-}
-
-int minValue(const std::vector<int> & msgs)
-{
-    int min = std::numeric_limits<int>::max();
-    for (std::vector<int>::const_iterator it = msgs.begin();
-            it != msgs.end(); it++)
-    {
-        min = std::min(min, *it);
-    }
-    return min;
-}
-
 // gather type is graphlab::empty, then we use message model
 class bmm: public graphlab::ivertex_program<graph_type, graphlab::empty,
-            set_union_gather>
+            bmm_message>, public graphlab::IS_POD_TYPE
 {
-    boost::unordered_set<int> msgs;
+    bmm_message msg;
     int update;
-    int minMsg;
 public:
 
     void init(icontext_type& context, const vertex_type& vertex,
-              const set_union_gather& msg)
+              const bmm_message& msg)
     {
-        this->msgs = msg.msgs;
-        this->minMsg = minValue(msg.msgs);
+        this->msg = msg;
         this->update = 0;
     }
 
@@ -113,7 +92,7 @@ public:
         {
             if(vertex.data().left == 0 && vertex.data().matchTo == -1)
             {
-                if (msgs.size() > 0)
+                if (msg.id != NO_ID)
                 {
                     update = 1;
                 }
@@ -123,17 +102,15 @@ public:
         {
             if(vertex.data().left == 1 && vertex.data().matchTo == -1)
             {
-                std::vector<int> grants;
-                for (boost::unordered_set<int>::const_iterator it = msgs.begin();
-                        it != msgs.end(); it++)
+                if (msg.id != NO_ID)
                 {
-                    if (*it >= 0)
-                        grants.push_back(*it);
+                    vertex.data().matchTo = msg.id;
+                    update = 1;
                 }
-                if (grants.size() > 0)
+                else if (msg.rejected)
                 {
-                    vertex.data().matchTo = minValue(grants);
-                    update = 1;
+                    // requests again in the next round
+                    context.signal(vertex);
                 }
             }
         }
@@ -141,11 +118,17 @@ public:
         {
             if(vertex.data().left == 0 && vertex.data().matchTo == -1)
             {
-                if (msgs.size() == 1)
+                // only the granted left vertex can accept
+                if (msg.id != NO_ID)
                 {
-                    vertex.data().matchTo = *msgs.begin();
+                    vertex.data().matchTo = msg.id;
+                    MATCHES.inc();
                 }
             }
+            else if(vertex.data().left == 1 && vertex.data().matchTo == -1)
+            {
+                context.signal(vertex);
+            }
         }
     }
 
@@ -171,22 +154,23 @@ public:
 
         if (context.iteration() % 4 == 0)
         {
-            set_union_gather m(vertex.id());
-            context.signal(edge.target(), m);
+            // matched right vertices ignore requests
+            if (edge.target().data().matchTo == -1)
+                context.signal(edge.target(), bmm_message(vertex.id()));
         }
         else if (context.iteration() % 4 == 1)
         {
-            if (edge.target().id() == minMsg)
+            const vertex_data& other = edge.target().data();
+            if (edge.target().id() == msg.id)
             {
-                set_union_gather m(vertex.id());
-                context.signal(edge.target(), m);
+                context.signal(edge.target(), bmm_message(vertex.id()));
             }
             else
             {
-                if (msgs.count(edge.target().id()))
+                // every unmatched left neighbour sent a request in phase 0
+                if (other.left == 1 && other.matchTo == -1)
                 {
-                    set_union_gather m(-vertex.id() - 1);
-                    context.signal(edge.target(), m);
+                    context.signal(edge.target(), bmm_message(NO_ID, true));
                 }
             }
 
@@ -195,26 +179,12 @@ public:
         {
             if (edge.target().id() == vertex.data().matchTo)
             {
-                set_union_gather m(vertex.id());
-                context.signal(edge.target(), m);
+                context.signal(edge.target(), bmm_message(vertex.id()));
             }
 
         }
     }
 
-    void save(graphlab::oarchive& oarc) const
-    {
-        oarc << msgs;
-        oarc << update;
-        oarc << minMsg;
-    }
-    void load(graphlab::iarchive& iarc)
-    {
-        iarc >> msgs;
-        iarc >> update;
-        iarc >> minMsg;
-    }
-
 };
 struct bmm_writer
 {
@@ -244,14 +214,11 @@ bool line_parser(graph_type& graph, const std::string& filename,
     }
     return true;
 }
-void copy_lastmatchto(graph_type::vertex_type& vdata)
-{
-    vdata.data().lastMatchTo = vdata.data().matchTo;
-}
-int vertex_data_change(const graph_type::vertex_type& vertex)
+bool unmatched_left(const graph_type::vertex_type& vertex)
 {
-    return (vertex.data().lastMatchTo == vertex.data().matchTo ? 0 : 1);
+    return vertex.data().left == 1 && vertex.data().matchTo == -1;
 }
+
 int main(int argc, char** argv)
 {
     graphlab::mpi_tools::init(argc, argv);
@@ -275,19 +242,13 @@ int main(int argc, char** argv)
     graphlab::omni_engine<bmm> engine(dc, graph, exec_type);
 
     t.start();
-    int round = 0;
-    while(true)
-    {
-        engine.signal_all();
-        engine.start();
-
-        int change = graph.map_reduce_vertices<int>(vertex_data_change);
-        dc.cout() << change << " vertices have been matched in round " << ++ round << std::endl;
-        if(change == 0)
-            break;
-        graph.transform_vertices(copy_lastmatchto);
-    }
+    engine.signal_vset(graph.select(unmatched_left));
+    engine.start();
+    const size_t round = (engine.iteration() + 3) / 4;
+    size_t matches = MATCHES.value;
+    dc.all_reduce(matches);
 
+    dc.cout() << 2 * matches << " vertices matched" << std::endl;
     dc.cout() << "Finished Running engine in " << t.current_time()
     << " seconds after " <<  round << " rounds." << std::endl;
 
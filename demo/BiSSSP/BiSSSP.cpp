@@ -0,0 +1,285 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdlib>
+
+#include <graphlab.hpp>
+
+/*
+ * Point-to-point shortest path query: a forward search from SOURCE over
+ * out-edges and a backward search from TARGET over in-edges run in the
+ * same supersteps. The "meet" aggregator tracks the best s-t distance
+ * found through any vertex and the smallest label on each frontier, and
+ * stops both searches once the two frontiers together cannot beat it.
+ */
+
+typedef double distance_type;
+
+const distance_type INF = std::numeric_limits<distance_type>::max();
+
+graphlab::vertex_id_type SOURCE = 0;
+graphlab::vertex_id_type TARGET = 0;
+// best meeting distance and stop flag, updated by the aggregator on every machine
+distance_type BEST = INF;
+bool STOP = false;
+
+struct vertex_data: graphlab::IS_POD_TYPE
+{
+    distance_type fwd;
+    distance_type bwd;
+    // superstep in which the label last improved and was scattered;
+    // the vertex is on that frontier only during this superstep
+    int fwd_step;
+    int bwd_step;
+    vertex_data() :
+        fwd(INF), bwd(INF), fwd_step(-1), bwd_step(-1)
+    {
+    }
+};
+
+struct edge_data: graphlab::IS_POD_TYPE
+{
+    distance_type dist;
+    edge_data(distance_type dist = 1) :
+        dist(dist)
+    {
+    }
+};
+typedef graphlab::distributed_graph<vertex_data, edge_data> graph_type;
+
+struct min_distance_type: graphlab::IS_POD_TYPE
+{
+    distance_type fwd;
+    distance_type bwd;
+    min_distance_type(distance_type fwd = INF, distance_type bwd = INF) :
+        fwd(fwd), bwd(bwd)
+    {
+    }
+    min_distance_type& operator+=(const min_distance_type& other)
+    {
+        fwd = std::min(fwd, other.fwd);
+        bwd = std::min(bwd, other.bwd);
+        return *this;
+    }
+};
+
+inline distance_type add_distance(distance_type a, distance_type b)
+{
+    return a == INF || b == INF ? INF : a + b;
+}
+
+// gather type is graphlab::empty, then we use message model
+class bi_sssp: public graphlab::ivertex_program<graph_type, graphlab::empty,
+    min_distance_type>, public graphlab::IS_POD_TYPE
+{
+    min_distance_type min_dist;
+public:
+
+    void init(icontext_type& context, const vertex_type& vertex,
+              const min_distance_type& msg)
+    {
+        min_dist = msg;
+    }
+
+    edge_dir_type gather_edges(icontext_type& context,
+                               const vertex_type& vertex) const
+    {
+        return graphlab::NO_EDGES;
+    }
+
+    void apply(icontext_type& context, vertex_type& vertex,
+               const graphlab::empty& empty)
+    {
+        vertex_data& data = vertex.data();
+        if (STOP)
+            return;
+        const int step = context.iteration();
+        // a label that already reaches BEST cannot lead to a shorter path
+        if (data.fwd > min_dist.fwd)
+        {
+            data.fwd = min_dist.fwd;
+            if (data.fwd < BEST)
+                data.fwd_step = step;
+        }
+        if (data.bwd > min_dist.bwd)
+        {
+            data.bwd = min_dist.bwd;
+            if (data.bwd < BEST)
+                data.bwd_step = step;
+        }
+    }
+
+    edge_dir_type scatter_edges(icontext_type& context,
+                                const vertex_type& vertex) const
+    {
+        const vertex_data& data = vertex.data();
+        const bool fwd_frontier = data.fwd_step == context.iteration();
+        const bool bwd_frontier = data.bwd_step == context.iteration();
+        if (fwd_frontier && bwd_frontier)
+            return graphlab::ALL_EDGES;
+        else if (fwd_frontier)
+            return graphlab::OUT_EDGES;
+        else if (bwd_frontier)
+            return graphlab::IN_EDGES;
+        else
+            return graphlab::NO_EDGES;
+    }
+
+    void scatter(icontext_type& context, const vertex_type& vertex,
+                 edge_type& edge) const
+    {
+        const vertex_data& data = vertex.data();
+        if (edge.source().id() == vertex.id())
+        {
+            if (data.fwd_step == context.iteration())
+                context.signal(edge.target(),
+                               min_distance_type(data.fwd + edge.data().dist, INF));
+        }
+        else
+        {
+            if (data.bwd_step == context.iteration())
+                context.signal(edge.source(),
+                               min_distance_type(INF, data.bwd + edge.data().dist));
+        }
+    }
+
+};
+
+struct meet_state_type: graphlab::IS_POD_TYPE
+{
+    distance_type best;
+    distance_type fwd_frontier;
+    distance_type bwd_frontier;
+    meet_state_type() :
+        best(INF), fwd_frontier(INF), bwd_frontier(INF)
+    {
+    }
+    meet_state_type& operator+=(const meet_state_type& other)
+    {
+        best = std::min(best, other.best);
+        fwd_frontier = std::min(fwd_frontier, other.fwd_frontier);
+        bwd_frontier = std::min(bwd_frontier, other.bwd_frontier);
+        return *this;
+    }
+};
+
+// only labels scattered in the superstep just finished are frontier labels
+meet_state_type meet_state(bi_sssp::icontext_type& context,
+                           const graph_type::vertex_type& vertex)
+{
+    meet_state_type state;
+    const vertex_data& data = vertex.data();
+    state.best = add_distance(data.fwd, data.bwd);
+    if (data.fwd_step == int(context.iteration()))
+        state.fwd_frontier = data.fwd;
+    if (data.bwd_step == int(context.iteration()))
+        state.bwd_frontier = data.bwd;
+    return state;
+}
+
+distance_type vertex_best(const graph_type::vertex_type& vertex)
+{
+    return add_distance(vertex.data().fwd, vertex.data().bwd);
+}
+
+struct min_best_type: graphlab::IS_POD_TYPE
+{
+    distance_type best;
+    min_best_type(distance_type best = INF) : best(best) { }
+    min_best_type& operator+=(const min_best_type& other)
+    {
+        best = std::min(best, other.best);
+        return *this;
+    }
+};
+
+min_best_type best_state(const graph_type::vertex_type& vertex)
+{
+    return min_best_type(vertex_best(vertex));
+}
+
+// every label still in flight is at least its frontier minimum, so no
+// undiscovered s-t path is shorter than the sum of both minima
+void check_meet(bi_sssp::icontext_type& context, const meet_state_type& state)
+{
+    BEST = std::min(BEST, state.best);
+    if (add_distance(state.fwd_frontier, state.bwd_frontier) >= BEST)
+        STOP = true;
+}
+
+size_t touched_vertex(const graph_type::vertex_type& vertex)
+{
+    return vertex.data().fwd != INF || vertex.data().bwd != INF;
+}
+
+bool line_parser(graph_type& graph, const std::string& filename,
+                 const std::string& textline)
+{
+
+    std::istringstream ssin(textline);
+    graphlab::vertex_id_type vid;
+    ssin >> vid;
+    int out_nb;
+    ssin >> out_nb;
+    if(out_nb == 0)
+        graph.add_vertex(vid);
+    while (out_nb--)
+    {
+        graphlab::vertex_id_type other_vid;
+        edge_data edge;
+        ssin >> other_vid >> edge.dist;
+        graph.add_edge(vid, other_vid, edge);
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << " <input_file> <source> <target>" << std::endl;
+        return EXIT_FAILURE;
+    }
+    graphlab::mpi_tools::init(argc, argv);
+    char *input_file = argv[1];
+    SOURCE = atol(argv[2]);
+    TARGET = atol(argv[3]);
+    std::string exec_type = "synchronous";
+    graphlab::distributed_control dc;
+    global_logger().set_log_level(LOG_INFO);
+
+    graphlab::timer t;
+    t.start();
+    graph_type graph(dc);
+    graph.load(input_file, line_parser);
+    graph.finalize();
+    dc.cout() << "Loading graph in " << t.current_time() << " seconds"
+              << std::endl;
+
+    graphlab::omni_engine<bi_sssp> engine(dc, graph, exec_type);
+    engine.add_vertex_aggregator<meet_state_type>("meet", meet_state, check_meet);
+    // an interval of 0 runs the aggregator after every superstep
+    engine.aggregate_periodic("meet", 0);
+
+    engine.signal(SOURCE, min_distance_type(0, INF));
+    engine.signal(TARGET, min_distance_type(INF, 0));
+    engine.start();
+
+    dc.cout() << "Finished Running engine in " << engine.elapsed_seconds()
+              << " seconds." << std::endl;
+
+    // the last superstep may have met after the final aggregation
+    BEST = std::min(BEST, graph.map_reduce_vertices<min_best_type>(best_state).best);
+
+    const size_t touched = graph.map_reduce_vertices<size_t>(touched_vertex);
+    if (BEST == INF)
+        dc.cout() << TARGET << " is not reachable from " << SOURCE << std::endl;
+    else
+        dc.cout() << "Distance from " << SOURCE << " to " << TARGET << ": " << BEST << std::endl;
+    dc.cout() << touched << " of " << graph.num_vertices()
+              << " vertices touched" << std::endl;
+
+    graphlab::mpi_tools::finalize();
+
+}
@@ -1,16 +1,56 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <cstdlib>
 
+#include <boost/unordered_set.hpp>
+#include <boost/unordered_map.hpp>
 #include <graphlab.hpp>
+#include "../local_union_find.hpp"
 
 typedef int color_type;
 
+/*
+ * Hook-and-compress connected components (Shiloach-Vishkin style). The
+ * color of a vertex is its parent pointer and always points to a smaller
+ * id of the same component. Every round
+ *   SEND:  vertices whose label changed send it to their neighbours,
+ *   HOOK:  a vertex that sees a smaller label hooks its root onto it,
+ *   ROOT:  roots take the smallest label hooked onto them,
+ *   JUMP:  parents are replaced by grandparents until every tree is a star.
+ * A round without any hook ends the run. The rounds needed grow with
+ * log n instead of the diameter; the labels end up as the minimum id of
+ * each component, as in the label-propagation program.
+ */
+bool POINTER_JUMPING = true;
+// start label propagation from the local union-find labels of every machine
+bool PRECONTRACT = true;
+std::vector<graphlab::vertex_id_type> LOCAL_LABELS;
+// seed the labels from a previous cc_writer output and relabel only the
+// components merged by a file of new edges
+bool INCREMENTAL = false;
+boost::unordered_set<graphlab::vertex_id_type> NEW_ENDPOINTS;
+// run label propagation and pointer jumping on a synthetic path and compare
+bool BENCH_POINTER_JUMPING = false;
+
+enum sv_phase_type { SV_SEND, SV_HOOK, SV_ROOT, SV_JUMP };
+sv_phase_type SV_PHASE = SV_SEND;
+bool SV_DONE = false;
+// labels of parents answered to this machine in the current JUMP superstep
+boost::unordered_map<graphlab::vertex_id_type, color_type> JUMP_LABELS;
+graphlab::mutex JUMP_LABELS_LOCK;
+
 struct vertex_data: graphlab::IS_POD_TYPE
 {
     color_type color;
+    // label changed since it was last sent to the neighbours
+    bool dirty;
+    // read by the "phase" aggregator: label changed in this superstep,
+    // jump request still unanswered
+    bool changed;
+    bool waiting;
     vertex_data(color_type color = std::numeric_limits<color_type>::max()) :
-        color(color)
+        color(color), dirty(false), changed(false), waiting(false)
     {
     }
 };
@@ -57,7 +97,16 @@ public:
     {
         if(context.iteration() == 0)
         {
-            vertex.data().color = vertex.id();
+            // vertices missing from the previous labels start from their id
+            if (INCREMENTAL)
+            {
+                if (vertex.data().color == std::numeric_limits<color_type>::max())
+                    vertex.data().color = vertex.id();
+            }
+            else if (!PRECONTRACT)
+            {
+                vertex.data().color = vertex.id();
+            }
             changed = true;
             return;
         }
@@ -83,14 +132,259 @@ public:
                  edge_type& edge) const
     {
 
-        const vertex_type other = edge.target();
+        const vertex_type other = edge.source().id() == vertex.id() ?
+                                  edge.target() : edge.source();
         color_type newc = vertex.data().color;
+        // labels only decrease, a neighbour at or below newc has nothing to learn
+        if (other.data().color <= newc)
+        {
+            // a vertex without a previous label pulls the smaller label of a
+            // neighbour that is not scheduled
+            if (INCREMENTAL && context.iteration() == 0 && other.data().color < newc)
+                context.signal(vertex, min_color_type(other.data().color));
+            return;
+        }
         const min_color_type msg(newc);
         context.signal(other,msg);
     }
 
 };
 
+/*
+ * The message of one superstep; only the fields of the current phase are
+ * read. A parent would have to answer every child of its tree, so jump
+ * requests are combined per machine: one representative (the smallest
+ * requester id) per requesting machine. The parent answers only those, and
+ * each representative publishes the label in JUMP_LABELS for the other
+ * children on its machine.
+ */
+struct sv_message_type
+{
+    typedef std::pair<graphlab::procid_t, graphlab::vertex_id_type> requester_type;
+
+    color_type neighbour_min;
+    color_type hook;
+    color_type reply;
+    std::vector<requester_type> requesters;
+    sv_message_type() :
+        neighbour_min(std::numeric_limits<color_type>::max()),
+        hook(std::numeric_limits<color_type>::max()),
+        reply(std::numeric_limits<color_type>::max())
+    {
+    }
+    sv_message_type& operator+=(const sv_message_type& other)
+    {
+        neighbour_min = std::min(neighbour_min, other.neighbour_min);
+        hook = std::min(hook, other.hook);
+        reply = std::min(reply, other.reply);
+        // at most one entry per machine
+        for (size_t i = 0; i < other.requesters.size(); ++i)
+        {
+            size_t j = 0;
+            while (j < requesters.size() &&
+                   requesters[j].first != other.requesters[i].first)
+                ++j;
+            if (j == requesters.size())
+                requesters.push_back(other.requesters[i]);
+            else
+                requesters[j].second = std::min(requesters[j].second,
+                                                other.requesters[i].second);
+        }
+        return *this;
+    }
+
+    void save(graphlab::oarchive& oarc) const
+    {
+        oarc << neighbour_min << hook << reply << requesters;
+    }
+    void load(graphlab::iarchive& iarc)
+    {
+        iarc >> neighbour_min >> hook >> reply >> requesters;
+    }
+};
+
+class sv_cc: public graphlab::ivertex_program<graph_type, graphlab::empty,
+    sv_message_type>
+{
+    sv_message_type msg;
+    bool send;
+public:
+
+    // the synchronous engine runs every init of a superstep before the
+    // first apply, so all children on this machine see the published label
+    void init(icontext_type& context, const vertex_type& vertex,
+              const sv_message_type& msg)
+    {
+        this->msg = msg;
+        if (SV_PHASE == SV_JUMP &&
+            msg.reply != std::numeric_limits<color_type>::max())
+        {
+            JUMP_LABELS_LOCK.lock();
+            JUMP_LABELS[vertex.data().color] = msg.reply;
+            JUMP_LABELS_LOCK.unlock();
+        }
+    }
+
+    edge_dir_type gather_edges(icontext_type& context,
+                               const vertex_type& vertex) const
+    {
+        return graphlab::NO_EDGES;
+    }
+
+    void apply(icontext_type& context, vertex_type& vertex,
+               const graphlab::empty& empty)
+    {
+        send = false;
+        if (SV_DONE)
+            return;
+        // every phase touches all vertices
+        context.signal(vertex);
+
+        vertex_data& data = vertex.data();
+        const color_type self = vertex.id();
+        data.changed = data.waiting = false;
+        if (SV_PHASE == SV_SEND)
+        {
+            send = data.dirty;
+            data.dirty = false;
+        }
+        else if (SV_PHASE == SV_HOOK)
+        {
+            if (msg.neighbour_min < data.color)
+            {
+                sv_message_type hook;
+                hook.hook = msg.neighbour_min;
+                context.signal_vid(data.color, hook);
+            }
+        }
+        else if (SV_PHASE == SV_ROOT)
+        {
+            if (msg.hook < data.color)
+            {
+                data.color = msg.hook;
+                data.dirty = data.changed = true;
+            }
+        }
+        else
+        {
+            // JUMP_LABELS is only written by the inits of this superstep
+            const boost::unordered_map<graphlab::vertex_id_type, color_type>::
+                const_iterator parent = JUMP_LABELS.find(data.color);
+            if (parent != JUMP_LABELS.end() && parent->second < data.color)
+            {
+                data.color = parent->second;
+                data.dirty = data.changed = true;
+            }
+            else if (data.color != self && parent == JUMP_LABELS.end())
+            {
+                data.waiting = true;
+            }
+            for (size_t i = 0; i < msg.requesters.size(); ++i)
+            {
+                sv_message_type reply;
+                reply.reply = data.color;
+                context.signal_vid(msg.requesters[i].second, reply);
+            }
+            if (data.color != self)
+            {
+                sv_message_type request;
+                request.requesters.push_back(
+                    sv_message_type::requester_type(context.procid(), self));
+                context.signal_vid(data.color, request);
+            }
+        }
+    }
+
+    edge_dir_type scatter_edges(icontext_type& context,
+                                const vertex_type& vertex) const
+    {
+        if (send)
+            return graphlab::ALL_EDGES;
+        else
+            return graphlab::NO_EDGES;
+    }
+
+    void scatter(icontext_type& context, const vertex_type& vertex,
+                 edge_type& edge) const
+    {
+        const vertex_type other = edge.source().id() == vertex.id() ?
+                                  edge.target() : edge.source();
+        sv_message_type label;
+        label.neighbour_min = vertex.data().color;
+        context.signal(other, label);
+    }
+
+    void save(graphlab::oarchive& oarc) const
+    {
+        oarc << msg << send;
+    }
+    void load(graphlab::iarchive& iarc)
+    {
+        iarc >> msg >> send;
+    }
+};
+
+struct sv_state_type: graphlab::IS_POD_TYPE
+{
+    size_t hooks;
+    size_t jumped;
+    size_t waiting;
+    sv_state_type() :
+        hooks(0), jumped(0), waiting(0)
+    {
+    }
+    sv_state_type& operator+=(const sv_state_type& other)
+    {
+        hooks += other.hooks;
+        jumped += other.jumped;
+        waiting += other.waiting;
+        return *this;
+    }
+};
+
+sv_state_type sv_state(sv_cc::icontext_type& context,
+                       const graph_type::vertex_type& vertex)
+{
+    sv_state_type state;
+    const vertex_data& data = vertex.data();
+    if (SV_PHASE == SV_ROOT)
+    {
+        state.hooks = data.changed;
+    }
+    else if (SV_PHASE == SV_JUMP)
+    {
+        state.jumped = data.changed;
+        state.waiting = data.waiting;
+    }
+    return state;
+}
+
+// runs on every machine after each superstep
+void sv_next_phase(sv_cc::icontext_type& context, const sv_state_type& state)
+{
+    // answers are only valid for the superstep they arrive in
+    JUMP_LABELS.clear();
+    if (SV_PHASE == SV_SEND)
+    {
+        SV_PHASE = SV_HOOK;
+    }
+    else if (SV_PHASE == SV_HOOK)
+    {
+        SV_PHASE = SV_ROOT;
+    }
+    else if (SV_PHASE == SV_ROOT)
+    {
+        if (state.hooks == 0)
+            SV_DONE = true;
+        SV_PHASE = SV_JUMP;
+    }
+    else if (state.jumped == 0 && state.waiting == 0)
+    {
+        // every parent answered without a change: all trees are stars
+        SV_PHASE = SV_SEND;
+    }
+}
+
 struct cc_writer
 {
     std::string save_vertex(const graph_type::vertex_type& vtx)
@@ -116,7 +410,8 @@ bool line_parser(graph_type& graph, const std::string& filename,
     ssin >> vid;
     int out_nb;
     ssin >> out_nb;
-    if(out_nb == 0)
+    // in incremental mode the vertices come with their previous label
+    if(out_nb == 0 && !INCREMENTAL)
         graph.add_vertex(vid);
     while (out_nb--)
     {
@@ -127,6 +422,126 @@ bool line_parser(graph_type& graph, const std::string& filename,
     return true;
 }
 
+// reads the cc_writer output of a previous run
+bool label_parser(graph_type& graph, const std::string& filename,
+                  const std::string& textline)
+{
+    std::istringstream ssin(textline);
+    graphlab::vertex_id_type vid;
+    color_type color;
+    if (ssin >> vid >> color)
+        graph.add_vertex(vid, vertex_data(color));
+    return true;
+}
+
+// one new edge per line: "src dst"
+bool new_edge_parser(graph_type& graph, const std::string& filename,
+                     const std::string& textline)
+{
+    std::istringstream ssin(textline);
+    graphlab::vertex_id_type vid, other_vid;
+    if (ssin >> vid >> other_vid)
+        graph.add_edge(vid, other_vid);
+    return true;
+}
+
+// every machine reads the (small) new edge file to know whom to signal
+void load_new_endpoints(const std::string& filename)
+{
+    std::ifstream fin(filename.c_str());
+    graphlab::vertex_id_type vid, other_vid;
+    while (fin >> vid >> other_vid)
+    {
+        NEW_ENDPOINTS.insert(vid);
+        NEW_ENDPOINTS.insert(other_vid);
+    }
+}
+
+bool is_new_endpoint(const graph_type::vertex_type& vertex)
+{
+    return NEW_ENDPOINTS.count(vertex.id()) > 0;
+}
+
+// new endpoints and vertices of the graph missing from the previous labels
+bool needs_relabel(const graph_type::vertex_type& vertex)
+{
+    return is_new_endpoint(vertex) ||
+           vertex.data().color == std::numeric_limits<color_type>::max();
+}
+
+void init_local_label(graph_type::vertex_type& vertex)
+{
+    vertex.data().color = LOCAL_LABELS[vertex.local_id()];
+}
+
+size_t is_label_root(const graph_type::vertex_type& vertex)
+{
+    return vertex.data().color == (color_type)vertex.id();
+}
+
+void init_vertex(graph_type::vertex_type& vertex)
+{
+    vertex.data() = vertex_data(vertex.id());
+    vertex.data().dirty = true;
+}
+
+// a path 0 - 1 - ... - n-1, whose diameter is as large as it gets
+void build_path(graph_type& graph, size_t n)
+{
+    if (graph.procid() != 0)
+        return;
+    for (size_t i = 0; i + 1 < n; ++i)
+        graph.add_edge(i, i + 1);
+}
+
+void run_engine(graphlab::distributed_control& dc, graph_type& graph,
+                const std::string& exec_type, bool pointer_jumping)
+{
+    graphlab::timer t;
+    t.start();
+    size_t supersteps;
+    if (pointer_jumping)
+    {
+        SV_PHASE = SV_SEND;
+        SV_DONE = false;
+        graph.transform_vertices(init_vertex);
+        graphlab::omni_engine<sv_cc> engine(dc, graph, exec_type);
+        engine.add_vertex_aggregator<sv_state_type>("phase", sv_state, sv_next_phase);
+        // an interval of 0 runs the aggregator after every superstep
+        engine.aggregate_periodic("phase", 0);
+        engine.signal_all();
+        engine.start();
+        supersteps = engine.iteration();
+    }
+    else
+    {
+        if (PRECONTRACT && !INCREMENTAL)
+        {
+            LOCAL_LABELS = local_component_labels(graph);
+            graph.transform_vertices(init_local_label);
+            dc.cout() << "Local union-find left "
+                      << graph.map_reduce_vertices<size_t>(is_label_root)
+                      << " vertices labelled with their own id in " << t.current_time()
+                      << " seconds" << std::endl;
+        }
+        graphlab::omni_engine<cc> engine(dc, graph, exec_type);
+        // an endpoint whose label equals its neighbour's sends nothing
+        if (INCREMENTAL)
+            engine.signal_vset(graph.select(needs_relabel));
+        else
+            engine.signal_all();
+        engine.start();
+        supersteps = engine.iteration();
+    }
+
+    dc.cout() << "Finished Running engine in " << t.current_time()
+              << " seconds." << std::endl;
+    if (BENCH_POINTER_JUMPING)
+        dc.cout() << (pointer_jumping ? "Pointer jumping" : "Label propagation") << ": "
+                  << supersteps << " supersteps, " << t.current_time()
+                  << " seconds" << std::endl;
+}
+
 int main(int argc, char** argv)
 {
     graphlab::mpi_tools::init(argc, argv);
@@ -141,28 +556,55 @@ int main(int argc, char** argv)
     graphlab::timer t;
     t.start();
     graph_type graph(dc);
-    graph.load(input_file, line_parser);
+    // optional: previous cc_writer output and a file of new edges
+    INCREMENTAL = !BENCH_POINTER_JUMPING && argc > 2;
+    // the benchmark takes the length of a synthetic path instead of a file
+    if (BENCH_POINTER_JUMPING)
+    {
+        build_path(graph, argc > 1 ? atol(argv[1]) : 100000);
+    }
+    else if (INCREMENTAL)
+    {
+        load_new_endpoints(argv[2]);
+        graph.load(argv[1], label_parser);
+        graph.load(argv[2], new_edge_parser);
+        graph.load(input_file, line_parser);
+    }
+    else
+    {
+        graph.load(input_file, line_parser);
+    }
     graph.finalize();
 
     dc.cout() << "Loading graph in " << t.current_time() << " seconds"
               << std::endl;
 
-    graphlab::omni_engine<cc> engine(dc, graph, exec_type);
-
-    engine.signal_all();
-
-    engine.start();
-
-    dc.cout() << "Finished Running engine in " << engine.elapsed_seconds()
-              << " seconds." << std::endl;
+    if (BENCH_POINTER_JUMPING)
+    {
+        // the baseline is plain label propagation: pre-contraction would
+        // settle whole components before the engine starts
+        const bool precontract = PRECONTRACT;
+        PRECONTRACT = false;
+        run_engine(dc, graph, exec_type, false);
+        PRECONTRACT = precontract;
+        run_engine(dc, graph, exec_type, true);
+    }
+    else
+    {
+        run_engine(dc, graph, exec_type, POINTER_JUMPING && !INCREMENTAL);
+    }
 
-    t.start();
+    // the benchmark graph is synthetic, keep it out of the real output
+    if (!BENCH_POINTER_JUMPING)
+    {
+        t.start();
 
-    graph.save(output_file, cc_writer(), false, // set to true if each output file is to be gzipped
-               true, // whether vertices are saved
-               false); // whether edges are saved
-    dc.cout() << "Dumping graph in " << t.current_time() << " seconds"
-              << std::endl;
+        graph.save(output_file, cc_writer(), false, // set to true if each output file is to be gzipped
+                   true, // whether vertices are saved
+                   false); // whether edges are saved
+        dc.cout() << "Dumping graph in " << t.current_time() << " seconds"
+                  << std::endl;
+    }
 
     graphlab::mpi_tools::finalize();
 }
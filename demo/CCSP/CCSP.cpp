@@ -3,14 +3,59 @@
 #include <fstream>
 
 #include <graphlab.hpp>
+#include "../phase_pipeline.hpp"
+#include "../vertex_bitset.hpp"
 
 typedef int color_type;
 const int BFS_SOURCE = 15588959; // hard code for frined
 //const int BFS_SOURCE = 75525479; // hard code for btc
+
+/*
+ * Direction-optimizing BFS: levels are expanded top-down (the frontier
+ * pushes to unvisited neighbours) while the frontier is small, and
+ * bottom-up (every unvisited vertex looks for a visited neighbour) while
+ * it covers a large part of the graph. The switch is made by the
+ * "frontier" aggregator from the edges each direction reads: a top-down
+ * level reads the frontier edges, a bottom-up level gathers ALL_EDGES of
+ * every unvisited vertex with no early exit on the first visited
+ * neighbour, i.e. all unexplored edges. The ALPHA = 14 of Beamer et al.
+ * relies on that early exit; here bottom-up only pays off once the
+ * frontier edges exceed the unexplored edges (ALPHA = 1). Go back
+ * top-down once the frontier edges drop below 1/BETA of the unexplored
+ * edges; BETA > ALPHA keeps a level near break-even from flipping the
+ * direction on every run.
+ */
+bool DIRECTION_OPTIMIZING = true;
+const size_t ALPHA = 1;
+const size_t BETA = 2;
+
+enum direction_type { TOP_DOWN, BOTTOM_UP };
+direction_type DIRECTION = TOP_DOWN;
+// level of the first superstep of the current engine run
+int BASE_LEVEL = 0;
+// set by the aggregator: finish the current direction
+bool SWITCH_DIRECTION = false;
+// set by the aggregator: a bottom-up level reached no new vertex
+bool BFS_DONE = false;
+// deepest level reached when the direction switches
+int FRONTIER_LEVEL = 0;
+
+/*
+ * Run BFS and CC as phases of one ccsp_program engine instead of two
+ * engines. The CC phase starts from the vertices the BFS did not reach.
+ * Either way the BFS is the ccsp_program BFS phase, so
+ * DIRECTION_OPTIMIZING holds for both.
+ */
+bool PIPELINE = true;
+enum phase_type { PHASE_BFS, PHASE_CC };
+phase_type PHASE = PHASE_BFS;
+
 struct vertex_data : graphlab::IS_POD_TYPE {
     color_type color;
+    // BFS level, -1 if not reached
+    int level;
     vertex_data(color_type color = std::numeric_limits<color_type>::max())
-        : color(color)
+        : color(color), level(-1)
     {
     }
 };
@@ -18,6 +63,13 @@ struct vertex_data : graphlab::IS_POD_TYPE {
 typedef graphlab::empty edge_data;
 typedef graphlab::distributed_graph<vertex_data, edge_data> graph_type;
 
+// local masters, those the BFS reached and the last level of a bottom-up
+// run that hands over to top-down; the programs set the bits, the driver
+// activates the next run from them
+vertex_bitset<graph_type> MASTERS;
+vertex_bitset<graph_type> VISITED;
+vertex_bitset<graph_type> FRONTIER;
+
 struct min_color_type : graphlab::IS_POD_TYPE {
     color_type color;
     min_color_type(color_type color = std::numeric_limits<color_type>::max())
@@ -31,11 +83,25 @@ struct min_color_type : graphlab::IS_POD_TYPE {
     }
 };
 
-// gather type is graphlab::empty, then we use message model
-class bfs : public graphlab::ivertex_program<graph_type, graphlab::empty,
-                                             min_color_type>,
-            public graphlab::IS_POD_TYPE {
-    bool changed;
+struct visited_neighbour_type : graphlab::IS_POD_TYPE {
+    bool found;
+    visited_neighbour_type(bool found = false)
+        : found(found)
+    {
+    }
+    visited_neighbour_type& operator+=(const visited_neighbour_type& other)
+    {
+        found = found || other.found;
+        return *this;
+    }
+};
+
+// the BFS phase is the direction-optimizing BFS, the CC phase is cc
+class ccsp_program : public graphlab::ivertex_program<graph_type,
+                                                      visited_neighbour_type,
+                                                      min_color_type>,
+                     public graphlab::IS_POD_TYPE {
+    bool expand;
     color_type min_color;
 
 public:
@@ -48,23 +114,61 @@ public:
     edge_dir_type gather_edges(icontext_type& context,
                                const vertex_type& vertex) const
     {
-        return graphlab::NO_EDGES;
+        if (PHASE == PHASE_BFS && DIRECTION == BOTTOM_UP)
+            return graphlab::ALL_EDGES;
+        else
+            return graphlab::NO_EDGES;
+    }
+
+    // gathers run before any apply of the superstep, so a neighbour
+    // visited in this level is not seen yet
+    visited_neighbour_type gather(icontext_type& context,
+                                  const vertex_type& vertex,
+                                  edge_type& edge) const
+    {
+        const vertex_type other = edge.source().id() == vertex.id() ?
+                                  edge.target() : edge.source();
+        return visited_neighbour_type(other.data().color == -1);
     }
 
     void apply(icontext_type& context, vertex_type& vertex,
-               const graphlab::empty& empty)
+               const gather_type& total)
     {
-        if (vertex.data().color == -1)
+        if (PHASE == PHASE_CC) {
+            apply_cc(context, vertex);
             return;
+        }
+        const int level = BASE_LEVEL + context.iteration();
+        expand = false;
+        if (DIRECTION == BOTTOM_UP) {
+            if (total.found) {
+                vertex.data().color = -1;
+                vertex.data().level = level;
+                VISITED.set(vertex.local_id());
+                if (SWITCH_DIRECTION)
+                    FRONTIER.set(vertex.local_id());
+            } else if (!SWITCH_DIRECTION && !BFS_DONE) {
+                // unvisited vertices look again in the next level
+                context.signal(vertex);
+            }
+            return;
+        }
 
-        vertex.data().color = -1;
-        changed = true;
+        if (vertex.data().color != -1) {
+            vertex.data().color = -1;
+            vertex.data().level = level;
+            VISITED.set(vertex.local_id());
+            expand = !SWITCH_DIRECTION;
+        } else {
+            // the frontier handed over by a bottom-up run
+            expand = vertex.data().level == level && !SWITCH_DIRECTION;
+        }
     }
 
     edge_dir_type scatter_edges(icontext_type& context,
                                 const vertex_type& vertex) const
     {
-        if (changed)
+        if (expand)
             return graphlab::ALL_EDGES;
         else
             return graphlab::NO_EDGES;
@@ -73,14 +177,196 @@ public:
     void scatter(icontext_type& context, const vertex_type& vertex,
                  edge_type& edge) const
     {
+        const vertex_type other = edge.source().id() == vertex.id() ?
+                                  edge.target() : edge.source();
+        if (PHASE == PHASE_BFS) {
+            if (other.data().color != -1)
+                context.signal(other);
+            return;
+        }
+        // reached vertices (-1) and neighbours at or below our label
+        // have nothing to learn
+        const color_type newc = vertex.data().color;
+        if (other.data().color > newc)
+            context.signal(other, min_color_type(newc));
+    }
 
-        const vertex_type other = edge.target();
-        color_type newc = vertex.data().color;
-        const min_color_type msg(newc);
-        context.signal(other, msg);
+private:
+    void apply_cc(icontext_type& context, vertex_type& vertex)
+    {
+        expand = false;
+        if (vertex.data().color == -1)
+            return;
+
+        if (context.iteration() == 0) {
+            vertex.data().color = vertex.id();
+            expand = true;
+            return;
+        }
+
+        if (vertex.data().color > min_color) {
+            expand = true;
+            vertex.data().color = min_color;
+        }
     }
 };
 
+struct frontier_state_type : graphlab::IS_POD_TYPE {
+    size_t frontier_vertices;
+    size_t frontier_edges;
+    size_t unexplored_edges;
+    size_t vertices;
+    frontier_state_type()
+        : frontier_vertices(0), frontier_edges(0), unexplored_edges(0),
+          vertices(0)
+    {
+    }
+    frontier_state_type& operator+=(const frontier_state_type& other)
+    {
+        frontier_vertices += other.frontier_vertices;
+        frontier_edges += other.frontier_edges;
+        unexplored_edges += other.unexplored_edges;
+        vertices += other.vertices;
+        return *this;
+    }
+};
+
+frontier_state_type frontier_state(ccsp_program::icontext_type& context,
+                                   const graph_type::vertex_type& vertex)
+{
+    frontier_state_type state;
+    if (PHASE != PHASE_BFS)
+        return state;
+    const size_t degree = vertex.num_in_edges() + vertex.num_out_edges();
+    state.vertices = 1;
+    if (vertex.data().color != -1) {
+        state.unexplored_edges = degree;
+    } else if (vertex.data().level == BASE_LEVEL + context.iteration()) {
+        state.frontier_vertices = 1;
+        state.frontier_edges = degree;
+    }
+    return state;
+}
+
+// runs on every machine after each superstep
+void choose_direction(ccsp_program::icontext_type& context,
+                      const frontier_state_type& state)
+{
+    if (PHASE != PHASE_BFS || !DIRECTION_OPTIMIZING)
+        return;
+    // the switch holds for the rest of the run: the level of the draining
+    // superstep is the frontier handed over to the next run
+    if (SWITCH_DIRECTION)
+        return;
+    if (state.frontier_vertices == 0) {
+        BFS_DONE = DIRECTION == BOTTOM_UP;
+        return;
+    }
+    if (DIRECTION == TOP_DOWN)
+        SWITCH_DIRECTION = state.frontier_edges * ALPHA > state.unexplored_edges;
+    else
+        SWITCH_DIRECTION = state.frontier_edges * BETA < state.unexplored_edges;
+}
+
+struct max_level_type : graphlab::IS_POD_TYPE {
+    int level;
+    max_level_type(int level = -1)
+        : level(level)
+    {
+    }
+    max_level_type& operator+=(const max_level_type& other)
+    {
+        level = std::max(level, other.level);
+        return *this;
+    }
+};
+
+max_level_type vertex_level(const graph_type::vertex_type& vertex)
+{
+    return max_level_type(vertex.data().level);
+}
+
+typedef graphlab::omni_engine<ccsp_program> ccsp_engine_type;
+
+// GraphLab cannot unregister an aggregator, so it is parked with a period
+// no run reaches
+const float AGGREGATE_NEVER = std::numeric_limits<float>::max();
+
+// alternates top-down and bottom-up engine runs until no level grows
+void run_bfs_phase(graphlab::distributed_control& dc, ccsp_engine_type& engine,
+                   graph_type& graph)
+{
+    if (DIRECTION_OPTIMIZING) {
+        // the frontier map visits every vertex, so it only runs after the
+        // supersteps of this phase
+        engine.add_vertex_aggregator<frontier_state_type>("frontier",
+                frontier_state, choose_direction);
+        // an interval of 0 runs the aggregator after every superstep
+        engine.aggregate_periodic("frontier", 0);
+    }
+    PHASE = PHASE_BFS;
+    DIRECTION = TOP_DOWN;
+    BASE_LEVEL = 0;
+    BFS_DONE = false;
+    MASTERS = vertex_bitset<graph_type>::masters(graph);
+    VISITED = vertex_bitset<graph_type>(graph);
+    FRONTIER = vertex_bitset<graph_type>(graph);
+    bool first = true;
+    while (!BFS_DONE) {
+        SWITCH_DIRECTION = false;
+
+        if (first) {
+            engine.signal(BFS_SOURCE);
+        } else {
+            const vertex_bitset<graph_type> active = DIRECTION == TOP_DOWN ?
+                FRONTIER : MASTERS - VISITED;
+            const size_t count = active.global_count(dc);
+            // the handed-over frontier is empty
+            if (count == 0)
+                break;
+            dc.cout() << count << " vertices start the "
+                      << (DIRECTION == TOP_DOWN ? "top-down" : "bottom-up")
+                      << " run" << std::endl;
+            engine.signal_vset(active.to_vertex_set(graph));
+        }
+        first = false;
+        FRONTIER.clear();
+        engine.start();
+
+        dc.cout() << (DIRECTION == TOP_DOWN ? "Top-down" : "Bottom-up")
+                  << " BFS from level " << BASE_LEVEL << " in "
+                  << engine.elapsed_seconds() << " seconds." << std::endl;
+
+        // without a switch a top-down run only drains on an empty frontier
+        // and a bottom-up run only on BFS_DONE
+        if (!SWITCH_DIRECTION)
+            break;
+        // the next run starts from the deepest level reached so far
+        FRONTIER_LEVEL = graph.map_reduce_vertices<max_level_type>(vertex_level).level;
+        if (DIRECTION == TOP_DOWN) {
+            DIRECTION = BOTTOM_UP;
+            BASE_LEVEL = FRONTIER_LEVEL + 1;
+        } else {
+            DIRECTION = TOP_DOWN;
+            BASE_LEVEL = FRONTIER_LEVEL;
+        }
+    }
+    if (DIRECTION_OPTIMIZING)
+        engine.aggregate_periodic("frontier", AGGREGATE_NEVER);
+}
+
+// only the vertices the BFS did not reach are scheduled
+void run_cc_phase(graphlab::distributed_control& dc, ccsp_engine_type& engine,
+                  graph_type& graph)
+{
+    PHASE = PHASE_CC;
+    const vertex_bitset<graph_type> active = MASTERS - VISITED;
+    dc.cout() << active.global_count(dc)
+              << " vertices start the CC phase" << std::endl;
+    engine.signal_vset(active.to_vertex_set(graph));
+    engine.start();
+}
+
 // gather type is graphlab::empty, then we use message model
 class cc : public graphlab::ivertex_program<graph_type, graphlab::empty,
                                             min_color_type>,
@@ -196,23 +482,24 @@ int main(int argc, char** argv)
     dc.cout() << "Loading graph in " << t.current_time() << " seconds"
               << std::endl;
 
-    graphlab::omni_engine<bfs> BFSEngine(dc, graph, exec_type);
-
-    BFSEngine.signal(BFS_SOURCE);
-
-    BFSEngine.start();
+    ccsp_engine_type engine(dc, graph, exec_type);
+    if (PIPELINE) {
+        phase_pipeline<ccsp_engine_type, graph_type> pipeline(dc, engine, graph);
+        pipeline.add_phase("bfs", boost::bind(run_bfs_phase, boost::ref(dc), _1, _2));
+        pipeline.add_phase("cc", boost::bind(run_cc_phase, boost::ref(dc), _1, _2));
+        pipeline.run();
+    } else {
+        run_bfs_phase(dc, engine, graph);
 
-    dc.cout() << "Finished Running engine in " << BFSEngine.elapsed_seconds()
-              << " seconds." << std::endl;
+        graphlab::omni_engine<cc> CCEngine(dc, graph, exec_type);
 
-    graphlab::omni_engine<cc> CCEngine(dc, graph, exec_type);
+        CCEngine.signal_all();
 
-    CCEngine.signal_all();
+        CCEngine.start();
 
-    CCEngine.start();
-
-    dc.cout() << "Finished Running engine in " << CCEngine.elapsed_seconds()
-              << " seconds." << std::endl;
+        dc.cout() << "Finished Running engine in " << CCEngine.elapsed_seconds()
+                  << " seconds." << std::endl;
+    }
 
     t.start();
 
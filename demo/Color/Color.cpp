@@ -21,6 +21,10 @@
  */
 
 
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <boost/cstdint.hpp>
 #include <boost/unordered_set.hpp>
 #include <graphlab.hpp>
 #include <graphlab/ui/metrics_server.hpp>
@@ -29,6 +33,39 @@
 
 typedef graphlab::vertex_id_type color_type;
 
+const color_type UNCOLORED = std::numeric_limits<color_type>::max();
+
+/*
+ * Jones-Plassmann coloring: a synchronous run in which every superstep
+ * colors the uncolored vertices whose priority beats all their
+ * uncolored neighbors. Those vertices form an independent set, so there
+ * are no conflicts to repair and the result depends only on the graph.
+ * BENCH_COLORING runs the asynchronous coloring and then this one.
+ */
+bool JONES_PLASSMANN = false;
+bool BENCH_COLORING = false;
+// vertex updates of the current run, and those that replaced a color;
+// only counted under BENCH_COLORING, every apply would contend on them
+graphlab::atomic<size_t> UPDATES;
+graphlab::atomic<size_t> RECOLORED;
+
+/*
+ * Vertex priority of both colorings. Jones-Plassmann colors higher
+ * priorities first, and largest-first then tends to need fewer colors.
+ * The asynchronous coloring does not order its updates by it; it only
+ * lets the lower priority endpoint of a monochrome edge give way, which
+ * under largest-first is the cheaper low degree side.
+ */
+enum ordering_type { ORDER_RANDOM, ORDER_LARGEST_FIRST };
+ordering_type ORDERING = ORDER_LARGEST_FIRST;
+// repair passes of the asynchronous coloring after the first one
+size_t MAX_REPAIR_PASSES = 10;
+// lower priority endpoints of the monochrome edges left by a pass: the
+// ones found on this machine, then those of all machines
+std::vector<graphlab::vertex_id_type> LOCAL_CONFLICTS;
+graphlab::mutex LOCAL_CONFLICTS_LOCK;
+boost::unordered_set<graphlab::vertex_id_type> CONFLICTS;
+
 /*
  * no edge data
  */
@@ -38,17 +75,43 @@ bool EDGE_CONSISTENT = false;
 
 /*
  * This is the gathering type which accumulates an (unordered) set of
- * all neighboring colors
- * It is a simple wrapper around a boost::unordered_set with
- * an operator+= which simply performs a set union.
+ * all neighboring colors, with an operator+= which performs a set union.
  *
- * This struct can be significantly accelerated for small sets.
- * Small collections of vertex IDs should not require the overhead
- * of the unordered_set.
+ * Up to INLINE_COLORS colors are kept in an inline array, so gathering
+ * and combining the colors of a small neighborhood never allocates.
+ * Larger sets switch to a dense bitset over the colors seen so far. The
+ * gather drops colors above the degree, which can never be the smallest
+ * free color, so the bitset covers at most colors 0..deg.
  */
 struct set_union_gather
 {
-    boost::unordered_set<color_type> colors;
+    static const size_t INLINE_COLORS = 8;
+
+    boost::uint32_t nsmall;
+    color_type small[INLINE_COLORS];
+    // dense mode once non-empty
+    std::vector<boost::uint64_t> bits;
+
+    set_union_gather() : nsmall(0) { }
+
+    void insert(color_type color)
+    {
+        if (bits.empty())
+        {
+            for (size_t i = 0; i < nsmall; ++i)
+                if (small[i] == color) return;
+            if (nsmall < INLINE_COLORS)
+            {
+                small[nsmall++] = color;
+                return;
+            }
+            // spill the inline colors into the bitset
+            for (size_t i = 0; i < nsmall; ++i)
+                set_bit(small[i]);
+            nsmall = 0;
+        }
+        set_bit(color);
+    }
 
     /*
      * Combining with another collection of vertices.
@@ -56,23 +119,69 @@ struct set_union_gather
      */
     set_union_gather& operator+=(const set_union_gather& other)
     {
-        foreach(graphlab::vertex_id_type othervid, other.colors)
+        if (other.bits.empty())
+        {
+            for (size_t i = 0; i < other.nsmall; ++i)
+                insert(other.small[i]);
+            return *this;
+        }
+        if (bits.empty())
         {
-            colors.insert(othervid);
+            for (size_t i = 0; i < nsmall; ++i)
+                set_bit(small[i]);
+            nsmall = 0;
         }
+        if (bits.size() < other.bits.size())
+            bits.resize(other.bits.size(), 0);
+        for (size_t w = 0; w < other.bits.size(); ++w)
+            bits[w] |= other.bits[w];
         return *this;
     }
 
+    // smallest color not in the set
+    color_type first_free() const
+    {
+        if (bits.empty())
+        {
+            // at most INLINE_COLORS colors, so the answer is below 64
+            boost::uint64_t used = 0;
+            for (size_t i = 0; i < nsmall; ++i)
+                if (small[i] < 64) used |= boost::uint64_t(1) << small[i];
+            return __builtin_ctzll(~used);
+        }
+        for (size_t w = 0; w < bits.size(); ++w)
+        {
+            if (~bits[w] != 0)
+                return 64 * w + __builtin_ctzll(~bits[w]);
+        }
+        return 64 * bits.size();
+    }
+
     // serialize
     void save(graphlab::oarchive& oarc) const
     {
-        oarc << colors;
+        oarc << nsmall;
+        for (size_t i = 0; i < nsmall; ++i)
+            oarc << small[i];
+        oarc << bits;
     }
 
     // deserialize
     void load(graphlab::iarchive& iarc)
     {
-        iarc >> colors;
+        iarc >> nsmall;
+        for (size_t i = 0; i < nsmall; ++i)
+            iarc >> small[i];
+        iarc >> bits;
+    }
+
+private:
+    void set_bit(color_type color)
+    {
+        const size_t w = color / 64;
+        if (bits.size() <= w)
+            bits.resize(w + 1, 0);
+        bits[w] |= boost::uint64_t(1) << (color % 64);
     }
 };
 
@@ -83,15 +192,68 @@ typedef graphlab::distributed_graph<color_type,
         edge_data_type> graph_type;
 
 
+// random but reproducible tie breaker
+inline boost::uint64_t vertex_hash(graphlab::vertex_id_type vid)
+{
+    boost::uint64_t h = vid * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
+}
+
+inline bool higher_priority(const graph_type::vertex_type& a,
+                            const graph_type::vertex_type& b)
+{
+    if (ORDERING == ORDER_LARGEST_FIRST)
+    {
+        const size_t da = a.num_in_edges() + a.num_out_edges();
+        const size_t db = b.num_in_edges() + b.num_out_edges();
+        if (da != db) return da > db;
+    }
+    const boost::uint64_t ha = vertex_hash(a.id()), hb = vertex_hash(b.id());
+    return ha != hb ? ha > hb : a.id() > b.id();
+}
+
+/*
+ * Colors of the colored neighbors; whether no uncolored neighbor has a
+ * higher priority (Jones-Plassmann) and whether a higher priority
+ * neighbor holds our color (asynchronous).
+ */
+struct neighborhood_gather
+{
+    bool local_max;
+    bool conflict;
+    set_union_gather colors;
+
+    neighborhood_gather() : local_max(true), conflict(false) { }
+
+    neighborhood_gather& operator+=(const neighborhood_gather& other)
+    {
+        local_max = local_max && other.local_max;
+        conflict = conflict || other.conflict;
+        colors += other.colors;
+        return *this;
+    }
+
+    void save(graphlab::oarchive& oarc) const
+    {
+        oarc << local_max << conflict << colors;
+    }
+
+    void load(graphlab::iarchive& iarc)
+    {
+        iarc >> local_max >> conflict >> colors;
+    }
+};
+
 /*
  * On gather, we accumulate a set of all adjacent colors.
  */
 class graph_coloring:
     public graphlab::ivertex_program<graph_type,
-    set_union_gather>,
+    neighborhood_gather>,
 /* I have no data. Just force it to POD */
 public graphlab::IS_POD_TYPE
 {
+    bool changed;
 public:
     // Gather on all edges
     edge_dir_type gather_edges(icontext_type& context,
@@ -108,63 +270,124 @@ public:
                        const vertex_type& vertex,
                        edge_type& edge) const
     {
-        set_union_gather gather;
-        color_type other_color = edge.source().id() == vertex.id() ?
-                                 edge.target().data(): edge.source().data();
-        // vertex_id_type otherid= edge.source().id() == vertex.id() ?
-        //                              edge.target().id(): edge.source().id();
-        gather.colors.insert(other_color);
+        neighborhood_gather gather;
+        const vertex_type other = edge.source().id() == vertex.id() ?
+                                  edge.target() : edge.source();
+        const color_type other_color = other.data();
+        // with deg neighbors some color in 0..deg is always free
+        if (other_color <= vertex.num_in_edges() + vertex.num_out_edges())
+            gather.colors.insert(other_color);
+        gather.conflict = other_color == vertex.data() &&
+                          other_color != UNCOLORED &&
+                          higher_priority(other, vertex);
         return gather;
     }
 
     /*
      * the gather result now contains the colors in the neighborhood.
-     * pick a different color and store it
+     * pick a different color and store it, unless the current one only
+     * collides with lower priority neighbors, which give way instead
      */
     void apply(icontext_type& context, vertex_type& vertex,
                const gather_type& neighborhood)
     {
+        changed = false;
+        if (vertex.data() != UNCOLORED && !neighborhood.conflict) return;
+        if (BENCH_COLORING && vertex.data() != UNCOLORED) RECOLORED.inc();
         // find the smallest color not described in the neighborhood
-        size_t neighborhoodsize = neighborhood.colors.size();
-        for (color_type curcolor = 0; curcolor < neighborhoodsize + 1; ++curcolor)
-        {
-            if (neighborhood.colors.count(curcolor) == 0)
-            {
-                vertex.data() = curcolor;
-                break;
-            }
-        }
+        if (BENCH_COLORING) UPDATES.inc();
+        vertex.data() = neighborhood.colors.first_free();
+        changed = true;
     }
 
 
     edge_dir_type scatter_edges(icontext_type& context,
                                 const vertex_type& vertex) const
     {
-        if (EDGE_CONSISTENT) return graphlab::NO_EDGES;
+        if (EDGE_CONSISTENT || !changed) return graphlab::NO_EDGES;
         else return graphlab::ALL_EDGES;
     }
 
 
     /*
-     * For each edge, count the intersection of the neighborhood of the
-     * adjacent vertices. This is the number of triangles this edge is involved
-     * in.
+     * A neighbor that picked the same color concurrently is a conflict;
+     * the lower priority endpoint is signalled to recolor.
      */
     void scatter(icontext_type& context,
                  const vertex_type& vertex,
                  edge_type& edge) const
     {
+        const vertex_type other = edge.source().id() == vertex.id() ?
+                                  edge.target() : edge.source();
         // both points have different colors!
-        if (edge.source().data() == edge.target().data())
+        if (other.data() == vertex.data())
         {
-            context.signal(edge.source().id() == vertex.id() ?
-                           edge.target() : edge.source());
+            if (higher_priority(vertex, other))
+                context.signal(other);
+            else
+                context.signal(vertex);
         }
     }
 };
 
+class jones_plassmann_coloring:
+    public graphlab::ivertex_program<graph_type, neighborhood_gather>,
+    public graphlab::IS_POD_TYPE
+{
+    bool colored;
+public:
+    edge_dir_type gather_edges(icontext_type& context,
+                               const vertex_type& vertex) const
+    {
+        if (vertex.data() != UNCOLORED) return graphlab::NO_EDGES;
+        return graphlab::ALL_EDGES;
+    }
+
+    gather_type gather(icontext_type& context,
+                       const vertex_type& vertex,
+                       edge_type& edge) const
+    {
+        neighborhood_gather gather;
+        const vertex_type other = edge.source().id() == vertex.id() ?
+                                  edge.target() : edge.source();
+        if (other.data() == UNCOLORED)
+            gather.local_max = !higher_priority(other, vertex);
+        else if (other.data() <= vertex.num_in_edges() + vertex.num_out_edges())
+            gather.colors.insert(other.data());
+        return gather;
+    }
+
+    void apply(icontext_type& context, vertex_type& vertex,
+               const gather_type& neighborhood)
+    {
+        colored = false;
+        if (vertex.data() != UNCOLORED || !neighborhood.local_max) return;
+        if (BENCH_COLORING) UPDATES.inc();
+        vertex.data() = neighborhood.colors.first_free();
+        colored = true;
+    }
 
+    edge_dir_type scatter_edges(icontext_type& context,
+                                const vertex_type& vertex) const
+    {
+        if (colored) return graphlab::ALL_EDGES;
+        else return graphlab::NO_EDGES;
+    }
 
+    /*
+     * A vertex waits for its higher priority neighbors, so it only needs
+     * to look again after one of them got its color.
+     */
+    void scatter(icontext_type& context,
+                 const vertex_type& vertex,
+                 edge_type& edge) const
+    {
+        const vertex_type other = edge.source().id() == vertex.id() ?
+                                  edge.target() : edge.source();
+        if (other.data() == UNCOLORED)
+            context.signal(other);
+    }
+};
 
 /*
  * A saver which saves a file where each line is a vid / color pair
@@ -188,9 +411,127 @@ struct save_colors
 /*                         Validation   Functions                         */
 /*                                                                        */
 /**************************************************************************/
+// a self-loop can never be resolved, it is not a conflict
 size_t validate_conflict(graph_type::edge_type& edge)
 {
-    return edge.source().data() == edge.target().data();
+    return edge.source().id() != edge.target().id() &&
+           edge.source().data() == edge.target().data();
+}
+
+// also records the endpoint that has to give way
+size_t find_conflict(graph_type::edge_type& edge)
+{
+    if (!validate_conflict(edge)) return 0;
+    const graphlab::vertex_id_type loser =
+        higher_priority(edge.source(), edge.target()) ?
+        edge.target().id() : edge.source().id();
+    LOCAL_CONFLICTS_LOCK.lock();
+    LOCAL_CONFLICTS.push_back(loser);
+    LOCAL_CONFLICTS_LOCK.unlock();
+    return 1;
+}
+
+// every machine learns the endpoints found on the others
+void share_conflicts(graphlab::distributed_control& dc)
+{
+    std::vector<std::vector<graphlab::vertex_id_type> > found(dc.numprocs());
+    found[dc.procid()].swap(LOCAL_CONFLICTS);
+    dc.all_gather(found);
+    CONFLICTS.clear();
+    for (size_t i = 0; i < found.size(); ++i)
+        CONFLICTS.insert(found[i].begin(), found[i].end());
+}
+
+bool is_conflicting(const graph_type::vertex_type& vertex)
+{
+    return CONFLICTS.count(vertex.id()) > 0;
+}
+
+struct max_color_type : graphlab::IS_POD_TYPE
+{
+    color_type color;
+    max_color_type(color_type color = 0) : color(color) { }
+    max_color_type& operator+=(const max_color_type& other)
+    {
+        color = std::max(color, other.color);
+        return *this;
+    }
+};
+
+max_color_type vertex_color(const graph_type::vertex_type& vertex)
+{
+    return max_color_type(vertex.data());
+}
+
+void init_vertex(graph_type::vertex_type& vertex)
+{
+    vertex.data() = UNCOLORED;
+}
+
+void run_engine(graphlab::distributed_control& dc, graph_type& graph,
+                const std::string& exec_type, bool jones_plassmann)
+{
+    UPDATES.value = 0;
+    RECOLORED.value = 0;
+    graph.transform_vertices(init_vertex);
+
+    double seconds = 0;
+    size_t rounds = 0;
+    size_t conflicts = 0;
+    dc.cout() << "Coloring..." << std::endl;
+    if (jones_plassmann)
+    {
+        graphlab::omni_engine<jones_plassmann_coloring> engine(dc, graph, "synchronous");
+        engine.signal_all();
+        engine.start();
+        seconds = engine.elapsed_seconds();
+        rounds = engine.iteration();
+        conflicts = graph.map_reduce_edges<size_t>(validate_conflict);
+    }
+    else
+    {
+        /*
+         * Without edge consistency two neighbors can pick the same color
+         * without seeing each other; a repair pass only schedules the
+         * lower priority ends of such edges, which recolor.
+         */
+        graphlab::omni_engine<graph_coloring> engine(dc, graph, exec_type);
+        engine.signal_all();
+        for (size_t pass = 0; ; ++pass)
+        {
+            engine.start();
+            seconds += engine.elapsed_seconds();
+            ++rounds;
+            LOCAL_CONFLICTS.clear();
+            conflicts = graph.map_reduce_edges<size_t>(find_conflict);
+            dc.cout() << "Pass " << pass << ": " << conflicts
+                      << " conflicting edges" << std::endl;
+            if (conflicts == 0 || pass == MAX_REPAIR_PASSES) break;
+            share_conflicts(dc);
+            engine.signal_vset(graph.select(is_conflicting));
+        }
+    }
+
+    dc.cout() << "Finished Running engine in " << seconds
+              << " seconds." << std::endl;
+
+    const color_type colors =
+        graph.map_reduce_vertices<max_color_type>(vertex_color).color + 1;
+    dc.cout() << (jones_plassmann ? "Jones-Plassmann" : "Asynchronous") << " ("
+              << (ORDERING == ORDER_LARGEST_FIRST ? "largest-first" : "random")
+              << "): " << rounds << (jones_plassmann ? " rounds, " : " passes, ");
+    if (BENCH_COLORING)
+    {
+        size_t updates = UPDATES.value;
+        dc.all_reduce(updates);
+        size_t recolored = RECOLORED.value;
+        dc.all_reduce(recolored);
+        dc.cout() << updates << " vertex updates, "
+                  << recolored << " recolorings, ";
+    }
+    dc.cout() << conflicts << " conflicts left, "
+              << colors << " colors, "
+              << seconds << " seconds" << std::endl;
 }
 
 
@@ -218,16 +559,15 @@ int main(int argc, char** argv)
 
     dc.cout() << "Loading graph in " << t.current_time() << " seconds"
 			<< std::endl;
-	graphlab::omni_engine<graph_coloring> engine(dc, graph, exec_type);
-
-    dc.cout() << "Coloring..." << std::endl;
-
-
-    engine.signal_all();
-    engine.start();
-
-    dc.cout() << "Finished Running engine in " << engine.elapsed_seconds()
-			<< " seconds." << std::endl;
+    if (BENCH_COLORING)
+    {
+        run_engine(dc, graph, exec_type, false);
+        run_engine(dc, graph, exec_type, true);
+    }
+    else
+    {
+        run_engine(dc, graph, exec_type, JONES_PLASSMANN);
+    }
 
 	t.start();
 
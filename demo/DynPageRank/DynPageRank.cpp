@@ -3,17 +3,61 @@
 #include <fstream>
 #include <cstdlib>
 
+#include <boost/unordered_set.hpp>
+#include <boost/unordered_map.hpp>
 #include <graphlab.hpp>
+#include "../PageRank/rank_storage.hpp"
 
 
 typedef double pagerank_type;
 
 const pagerank_type EPS = 0.01;
 
+typedef std::pair<graphlab::vertex_id_type, graphlab::vertex_id_type> edge_key_type;
+
+// incremental mode: ranks are seeded from a previous run and only the
+// endpoints of the inserted and deleted edges are signalled
+bool INCREMENTAL = false;
+std::vector<edge_key_type> INSERTED_EDGES;
+boost::unordered_set<edge_key_type> DELETED_EDGES;
+boost::unordered_set<graphlab::vertex_id_type> CHANGED_SOURCES;
+boost::unordered_set<graphlab::vertex_id_type> CHANGED_TARGETS;
+// rank of vertices created by the ingress without an explicit rank; in
+// incremental mode it marks vertices missing from the previous ranks
+const pagerank_type NEW_RANK = -1.0;
+pagerank_type INITIAL_RANK = 1.0;
+
+// keep the gather result of every vertex cached and let scatter post the
+// change of its contribution, so a reactivated vertex does not re-gather;
+// every change is posted, also the ones too small to signal, or the
+// caches would drift from the ranks
+bool GATHER_CACHE = false;
+// run once with the cache off and once with it on, and compare edge reads
+bool BENCH_GATHER_CACHE = false;
+graphlab::atomic<size_t> EDGE_READS;
+graphlab::atomic<size_t> ACTIVATIONS;
+
+// asynchronous runs schedule the largest pending change first, and a
+// vertex whose accumulated incoming change stays below RESIDUAL_CUTOFF
+// skips its update; synchronous runs ignore both
+bool PRIORITY_SCHEDULING = true;
+pagerank_type RESIDUAL_CUTOFF = EPS / 10;
+// set by run_engine for asynchronous runs with PRIORITY_SCHEDULING
+bool USE_CUTOFF = false;
+// residual of the signals run_engine starts from: these vertices have not
+// been computed at all, so they pass the cutoff and come first
+const pagerank_type SEED_RESIDUAL = 1.0;
+// run synchronously, then asynchronously with PRIORITY_SCHEDULING, and
+// compare the ranks
+bool CHECK_PRIORITY_SCHEDULING = false;
+const pagerank_type CHECK_TOLERANCE = 10 * EPS;
+
 struct vertex_data: graphlab::IS_POD_TYPE {
-	pagerank_type pagerank;
-	vertex_data(pagerank_type pagerank = 1.0) :
-			pagerank(pagerank) {
+	stored_rank pagerank;
+	// incoming change signalled but not yet large enough for an update
+	pagerank_type residual;
+	vertex_data(pagerank_type pagerank = INITIAL_RANK) :
+			pagerank(pagerank), residual(0) {
 	}
 };
 
@@ -21,7 +65,7 @@ typedef graphlab::empty edge_data;
 
 typedef graphlab::distributed_graph<vertex_data, edge_data> graph_type;
 
-struct sum_pagerank_type: graphlab::IS_POD_TYPE {
+struct sum_pagerank_type {
 	pagerank_type pagerank;
 	sum_pagerank_type(pagerank_type pagerank = 0) :
 		pagerank(pagerank) {
@@ -30,21 +74,67 @@ struct sum_pagerank_type: graphlab::IS_POD_TYPE {
 		pagerank += other.pagerank;
 		return *this;
 	}
+	void save(graphlab::oarchive& oarc) const {
+		save_rank(oarc, pagerank);
+	}
+	void load(graphlab::iarchive& iarc) {
+		load_rank(iarc, pagerank);
+	}
 };
 
-// gather type is graphlab::empty, then we use message model
-class pagerank: public graphlab::ivertex_program<graph_type, sum_pagerank_type >, public graphlab::IS_POD_TYPE {
+/*
+ * The message carries the pending rank change of the receiver, which the
+ * priority scheduler uses as the priority, and can force the receiver to
+ * scatter after apply. A vertex whose out-degree changed has to signal
+ * its out-neighbours even when its own rank did not move, since its
+ * contribution to them did.
+ */
+struct pagerank_signal_type: graphlab::IS_POD_TYPE {
+	pagerank_type residual;
+	bool force;
+	pagerank_signal_type(pagerank_type residual = 0, bool force = false) :
+		residual(residual), force(force) {
+	}
+	pagerank_signal_type& operator+=(const pagerank_signal_type& other) {
+		residual += other.residual;
+		force = force || other.force;
+		return *this;
+	}
+	double priority() const {
+		return residual;
+	}
+};
+
+class pagerank: public graphlab::ivertex_program<graph_type, sum_pagerank_type,
+		pagerank_signal_type>, public graphlab::IS_POD_TYPE {
 	bool converged;
+	bool force;
+	bool skip;
+	pagerank_type residual;
+	pagerank_type last_change;
 public:
 
+	void init(icontext_type& context, const vertex_type& vertex,
+			const pagerank_signal_type& msg) {
+		force = msg.force;
+		residual = msg.residual;
+		// the cutoff applies to the sum of everything received so far
+		skip = USE_CUTOFF && !force &&
+			vertex.data().residual + residual < RESIDUAL_CUTOFF;
+	}
+
 	edge_dir_type gather_edges(icontext_type& context,
 	                              const vertex_type& vertex) const {
+	    if (skip)
+	        return graphlab::NO_EDGES;
 	    return graphlab::IN_EDGES;
 	  }
 
 
 	sum_pagerank_type gather(icontext_type& context, const vertex_type& vertex,
 	               edge_type& edge) const {
+	    if (BENCH_GATHER_CACHE)
+	        EDGE_READS.inc();
 	    return sum_pagerank_type(edge.source().data().pagerank / edge.source().num_out_edges());
 	  }
 
@@ -52,20 +142,29 @@ public:
 	 void apply(icontext_type& context, vertex_type& vertex,
 	             const gather_type& total) {
 		converged = true;
+		last_change = 0;
+		if (skip) {
+			vertex.data().residual += residual;
+			return;
+		}
+		vertex.data().residual = 0;
+		if (BENCH_GATHER_CACHE)
+			ACTIVATIONS.inc();
 		double new_pagerank = 0.15 + 0.85 * total.pagerank;
-		double delta = fabs(vertex.data().pagerank - new_pagerank);
+		last_change = new_pagerank - vertex.data().pagerank;
+		double delta = fabs(last_change);
 		vertex.data().pagerank = new_pagerank;
-        if (delta > EPS) {
+        if (delta > EPS || force) {
 			converged = false;
 		}
 	}
 
 	edge_dir_type scatter_edges(icontext_type& context,
 			const vertex_type& vertex) const {
-		if (converged)
-			return graphlab::NO_EDGES;
-		else
+		if (!converged || (GATHER_CACHE && last_change != 0))
 			return graphlab::OUT_EDGES;
+		else
+			return graphlab::NO_EDGES;
 	}
 	; // end of scatter_edges
 
@@ -75,7 +174,11 @@ public:
 	void scatter(icontext_type& context, const vertex_type& vertex,
 			edge_type& edge) const {
 		const vertex_type other = edge.target();
-		context.signal(other);
+		const pagerank_type contribution = last_change / vertex.num_out_edges();
+		if (GATHER_CACHE)
+			context.post_delta(other, sum_pagerank_type(contribution));
+		if (!converged)
+			context.signal(other, pagerank_signal_type(0.85 * fabs(contribution)));
 
 	}
 
@@ -98,23 +201,141 @@ bool line_parser(graph_type& graph, const std::string& filename,
     std::istringstream ssin(textline);
     graphlab::vertex_id_type vid;
     ssin >> vid;
-    graph.add_vertex(vid);
+    // in incremental mode the vertices come with their previous rank
+    if (!INCREMENTAL)
+        graph.add_vertex(vid);
     int out_nb;
     ssin >> out_nb;
-    if(out_nb == 0) 
+    if(out_nb == 0 && !INCREMENTAL)
         graph.add_vertex(vid);
 
     while (out_nb--) {
         graphlab::vertex_id_type other_vid;
         ssin >> other_vid;
-        if(vid != other_vid)
+        if(vid != other_vid && DELETED_EDGES.count(edge_key_type(vid, other_vid)) == 0)
             graph.add_edge(vid, other_vid);
     }
     return true;
 }
 
+// reads the pagerank_writer output of a previous run
+bool rank_parser(graph_type& graph, const std::string& filename,
+		const std::string& textline) {
+    std::istringstream ssin(textline);
+    graphlab::vertex_id_type vid;
+    pagerank_type rank;
+    if (ssin >> vid >> rank)
+        graph.add_vertex(vid, vertex_data(rank));
+    return true;
+}
+
+// one edge update per line: "+ src dst" for an insertion, "- src dst" for a deletion
+void load_edge_updates(const std::string& filename) {
+    std::ifstream fin(filename.c_str());
+    std::string textline;
+    while (std::getline(fin, textline)) {
+        std::istringstream ssin(textline);
+        char op;
+        graphlab::vertex_id_type src, dst;
+        if (!(ssin >> op >> src >> dst) || src == dst)
+            continue;
+        if (op == '+')
+            INSERTED_EDGES.push_back(edge_key_type(src, dst));
+        else if (op == '-')
+            DELETED_EDGES.insert(edge_key_type(src, dst));
+        else
+            continue;
+        CHANGED_SOURCES.insert(src);
+        CHANGED_TARGETS.insert(dst);
+    }
+}
+
+bool is_changed_source(const graph_type::vertex_type& v) { return CHANGED_SOURCES.count(v.id()) > 0; }
+
+bool is_changed_target(const graph_type::vertex_type& v) { return CHANGED_TARGETS.count(v.id()) > 0; }
+
+void init_vertex(graph_type::vertex_type& vertex) { vertex.data().pagerank = 1.0; }
+
+bool is_new_vertex(const graph_type::vertex_type& v) { return v.data().pagerank == NEW_RANK; }
+
+// vertices without a previous rank start from the base rank
+void seed_new_vertex(graph_type::vertex_type& vertex) {
+    if (vertex.data().pagerank == NEW_RANK)
+        vertex.data().pagerank = 0.15;
+}
+
+void run_engine(graphlab::distributed_control& dc, graph_type& graph,
+                const std::string& exec_type, bool use_cache) {
+    GATHER_CACHE = use_cache;
+    EDGE_READS.value = 0;
+    ACTIVATIONS.value = 0;
+
+    USE_CUTOFF = PRIORITY_SCHEDULING && exec_type != "synchronous";
+
+    graphlab::graphlab_options opts;
+    opts.get_engine_args().set_option("use_cache", use_cache);
+    if (USE_CUTOFF)
+        opts.set_scheduler_type("priority");
+	graphlab::omni_engine<pagerank> engine(dc, graph, exec_type, opts);
+
+    if (INCREMENTAL) {
+        engine.signal_vset(graph.select(is_changed_target),
+                           pagerank_signal_type(SEED_RESIDUAL));
+        engine.signal_vset(graph.select(is_changed_source), pagerank_signal_type(0, true));
+        // a new vertex passes its base rank on to its out-neighbours
+        engine.signal_vset(graph.select(is_new_vertex), pagerank_signal_type(0, true));
+        graph.transform_vertices(seed_new_vertex);
+        dc.cout() << "Applying " << INSERTED_EDGES.size() << " insertions and "
+                  << DELETED_EDGES.size() << " deletions" << std::endl;
+    } else {
+        engine.signal_all(pagerank_signal_type(SEED_RESIDUAL));
+    }
+	engine.start();
+
+	dc.cout() << "Finished Running engine in " << engine.elapsed_seconds()
+			<< " seconds." << std::endl;
+
+    if (BENCH_GATHER_CACHE) {
+        size_t edge_reads = EDGE_READS.value;
+        size_t activations = ACTIVATIONS.value;
+        dc.all_reduce(edge_reads);
+        dc.all_reduce(activations);
+        dc.cout() << "Gather cache " << (use_cache ? "on" : "off") << ": "
+                  << edge_reads << " edge reads over " << activations << " activations, "
+                  << (activations == 0 ? 0.0 : double(edge_reads) / activations)
+                  << " per activation" << std::endl;
+    }
+}
+
 double map_rank(const graph_type::vertex_type& v) { return v.data().pagerank; }
 
+// ranks of the synchronous run of CHECK_PRIORITY_SCHEDULING, per master
+boost::unordered_map<graphlab::vertex_id_type, pagerank_type> REFERENCE_RANKS;
+graphlab::mutex REFERENCE_RANKS_LOCK;
+
+void save_reference_rank(graph_type::vertex_type& vertex) {
+    REFERENCE_RANKS_LOCK.lock();
+    REFERENCE_RANKS[vertex.id()] = vertex.data().pagerank;
+    REFERENCE_RANKS_LOCK.unlock();
+}
+
+struct max_diff_type: graphlab::IS_POD_TYPE {
+    pagerank_type diff;
+    max_diff_type(pagerank_type diff = 0) : diff(diff) { }
+    max_diff_type& operator+=(const max_diff_type& other) {
+        diff = std::max(diff, other.diff);
+        return *this;
+    }
+};
+
+max_diff_type reference_diff(const graph_type::vertex_type& v) {
+    const boost::unordered_map<graphlab::vertex_id_type, pagerank_type>::const_iterator
+        reference = REFERENCE_RANKS.find(v.id());
+    if (reference == REFERENCE_RANKS.end())
+        return max_diff_type();
+    return max_diff_type(fabs(v.data().pagerank - reference->second));
+}
+
 
 int main(int argc, char** argv) {
 	graphlab::mpi_tools::init(argc, argv);
@@ -122,6 +343,10 @@ int main(int argc, char** argv) {
     char *input_file = argv[1];
     char *output_file = "hdfs://master:9000/exp/pagerank";
     std::string exec_type = argv[2];
+    // optional: previous rank output and a file of edge updates
+    INCREMENTAL = argc > 4;
+    if (INCREMENTAL)
+        INITIAL_RANK = NEW_RANK;
 
 
     graphlab::distributed_control dc;
@@ -130,18 +355,38 @@ int main(int argc, char** argv) {
     graphlab::timer t;
     t.start();
 	graph_type graph(dc);
+    if (INCREMENTAL) {
+        load_edge_updates(argv[4]);
+        graph.load(argv[3], rank_parser);
+    }
 	graph.load(input_file, line_parser);
+    if (INCREMENTAL && dc.procid() == 0) {
+        for (size_t i = 0; i < INSERTED_EDGES.size(); ++i)
+            graph.add_edge(INSERTED_EDGES[i].first, INSERTED_EDGES[i].second);
+    }
     graph.finalize();
 
     dc.cout() << "Loading graph in " << t.current_time() << " seconds" << std::endl;
 	//std::string exec_type = "synchronous";
-	graphlab::omni_engine<pagerank> engine(dc, graph, exec_type);
-
-	engine.signal_all();
-	engine.start();
-
-	dc.cout() << "Finished Running engine in " << engine.elapsed_seconds()
-			<< " seconds." << std::endl;
+    // the benchmark restarts from the uniform rank, so it needs a full run
+    if (CHECK_PRIORITY_SCHEDULING && !INCREMENTAL) {
+        PRIORITY_SCHEDULING = true;
+        run_engine(dc, graph, "synchronous", GATHER_CACHE);
+        graph.transform_vertices(save_reference_rank);
+        graph.transform_vertices(init_vertex);
+        run_engine(dc, graph, "asynchronous", GATHER_CACHE);
+        const pagerank_type diff =
+            graph.map_reduce_vertices<max_diff_type>(reference_diff).diff;
+        dc.cout() << "Priority scheduling: largest rank difference to the "
+                  << "synchronous run " << diff
+                  << (diff <= CHECK_TOLERANCE ? " (ok)" : " (MISMATCH)") << std::endl;
+    } else if (BENCH_GATHER_CACHE && !INCREMENTAL) {
+        run_engine(dc, graph, exec_type, false);
+        graph.transform_vertices(init_vertex);
+        run_engine(dc, graph, exec_type, true);
+    } else {
+        run_engine(dc, graph, exec_type, GATHER_CACHE);
+    }
 
     const double total_rank = graph.map_reduce_vertices<double>(map_rank);
     std::cout << "Total rank: " << total_rank << std::endl;
@@ -0,0 +1,279 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+
+#include <boost/cstdint.hpp>
+#include <boost/static_assert.hpp>
+#include <graphlab.hpp>
+
+/*
+ * Multi-source SSSP: every vertex keeps one distance lane per source and
+ * up to LANES sources are solved in a single engine run over the once-loaded
+ * graph; longer source lists run in batches of LANES, each written to
+ * output_file_<batch>. Compile with -DSSSP_LANES=64 for more landmarks per run.
+ */
+
+typedef double distance_type;
+typedef boost::uint64_t lane_mask_type;
+
+#ifndef SSSP_LANES
+#define SSSP_LANES 16
+#endif
+const size_t LANES = SSSP_LANES;
+BOOST_STATIC_ASSERT(SSSP_LANES <= 64);
+
+const distance_type INF = std::numeric_limits<distance_type>::max();
+
+struct vertex_data: graphlab::IS_POD_TYPE
+{
+    distance_type dist[LANES];
+    vertex_data()
+    {
+        for (size_t k = 0; k < LANES; ++k)
+            dist[k] = INF;
+    }
+};
+
+struct edge_data: graphlab::IS_POD_TYPE
+{
+    distance_type dist;
+    edge_data(distance_type dist = 1) :
+        dist(dist)
+    {
+    }
+};
+typedef graphlab::distributed_graph<vertex_data, edge_data> graph_type;
+
+/*
+ * Lanes that carry no improvement hold INF. Combining takes the lane-wise
+ * minimum over a fixed trip count, which the compiler turns into packed
+ * min instructions; on the wire only the finite lanes are written.
+ */
+struct min_distance_type
+{
+    distance_type dist[LANES];
+    min_distance_type()
+    {
+        for (size_t k = 0; k < LANES; ++k)
+            dist[k] = INF;
+    }
+    min_distance_type& operator+=(const min_distance_type& other)
+    {
+        for (size_t k = 0; k < LANES; ++k)
+            dist[k] = dist[k] < other.dist[k] ? dist[k] : other.dist[k];
+        return *this;
+    }
+
+    void save(graphlab::oarchive& oarc) const
+    {
+        lane_mask_type mask = 0;
+        for (size_t k = 0; k < LANES; ++k)
+            if (dist[k] != INF)
+                mask |= lane_mask_type(1) << k;
+        oarc << mask;
+        for (size_t k = 0; k < LANES; ++k)
+            if ((mask >> k) & 1)
+                oarc << dist[k];
+    }
+    void load(graphlab::iarchive& iarc)
+    {
+        lane_mask_type mask;
+        iarc >> mask;
+        for (size_t k = 0; k < LANES; ++k)
+        {
+            dist[k] = INF;
+            if ((mask >> k) & 1)
+                iarc >> dist[k];
+        }
+    }
+};
+
+// gather type is graphlab::empty, then we use message model
+class multi_sssp: public graphlab::ivertex_program<graph_type, graphlab::empty,
+    min_distance_type>, public graphlab::IS_POD_TYPE
+{
+    min_distance_type min_dist;
+    // lanes improved by the last apply
+    lane_mask_type changed;
+public:
+
+    void init(icontext_type& context, const vertex_type& vertex,
+              const min_distance_type& msg)
+    {
+        min_dist = msg;
+    }
+
+    edge_dir_type gather_edges(icontext_type& context,
+                               const vertex_type& vertex) const
+    {
+        return graphlab::NO_EDGES;
+    }
+
+    void apply(icontext_type& context, vertex_type& vertex,
+               const graphlab::empty& empty)
+    {
+        changed = 0;
+        for (size_t k = 0; k < LANES; ++k)
+        {
+            if (vertex.data().dist[k] > min_dist.dist[k])
+            {
+                changed |= lane_mask_type(1) << k;
+                vertex.data().dist[k] = min_dist.dist[k];
+            }
+        }
+    }
+
+    edge_dir_type scatter_edges(icontext_type& context,
+                                const vertex_type& vertex) const
+    {
+        if (changed)
+            return graphlab::OUT_EDGES;
+        else
+            return graphlab::NO_EDGES;
+    }
+
+    // one message per edge, holding only the improved lanes
+    void scatter(icontext_type& context, const vertex_type& vertex,
+                 edge_type& edge) const
+    {
+        min_distance_type msg;
+        for (size_t k = 0; k < LANES; ++k)
+        {
+            if ((changed >> k) & 1)
+                msg.dist[k] = vertex.data().dist[k] + edge.data().dist;
+        }
+        context.signal(edge.target(), msg);
+    }
+
+};
+
+struct multi_sssp_writer
+{
+    size_t nsources;
+    multi_sssp_writer(size_t nsources) : nsources(nsources) { }
+    std::string save_vertex(const graph_type::vertex_type& vtx)
+    {
+        std::stringstream strm;
+        bool reached = false;
+        strm << vtx.id();
+        for (size_t k = 0; k < nsources; ++k)
+        {
+            if (vtx.data().dist[k] == INF)
+            {
+                strm << "\tinf";
+            }
+            else
+            {
+                strm << "\t" << vtx.data().dist[k];
+                reached = true;
+            }
+        }
+        strm << "\n";
+        if (reached)
+            return strm.str();
+        else
+            return "";
+    }
+    std::string save_edge(graph_type::edge_type e)
+    {
+        return "";
+    }
+};
+
+bool line_parser(graph_type& graph, const std::string& filename,
+                 const std::string& textline)
+{
+
+    std::istringstream ssin(textline);
+    graphlab::vertex_id_type vid;
+    ssin >> vid;
+    int out_nb;
+    ssin >> out_nb;
+    if(out_nb == 0)
+        graph.add_vertex(vid);
+    while (out_nb--)
+    {
+        graphlab::vertex_id_type other_vid;
+        edge_data edge;
+        ssin >> other_vid >> edge.dist;
+        graph.add_edge(vid, other_vid, edge);
+    }
+    return true;
+}
+
+// one source vertex id per line
+std::vector<graphlab::vertex_id_type> load_sources(const std::string& filename)
+{
+    std::vector<graphlab::vertex_id_type> sources;
+    std::ifstream fin(filename.c_str());
+    graphlab::vertex_id_type vid;
+    while (fin >> vid)
+        sources.push_back(vid);
+    return sources;
+}
+
+void init_vertex(graph_type::vertex_type& vertex)
+{
+    vertex.data() = vertex_data();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << " <input_file> <source_file> <output_file>" << std::endl;
+        return EXIT_FAILURE;
+    }
+    graphlab::mpi_tools::init(argc, argv);
+    char *input_file = argv[1];
+    char *source_file = argv[2];
+    std::string output_file = argv[3];
+    std::string exec_type = "synchronous";
+    graphlab::distributed_control dc;
+    global_logger().set_log_level(LOG_INFO);
+
+    graphlab::timer t;
+    t.start();
+    graph_type graph(dc);
+    graph.load(input_file, line_parser);
+    graph.finalize();
+    dc.cout() << "Loading graph in " << t.current_time() << " seconds"
+              << std::endl;
+
+    const std::vector<graphlab::vertex_id_type> sources = load_sources(source_file);
+    dc.cout() << "Solving " << sources.size() << " sources in batches of "
+              << LANES << std::endl;
+
+    graphlab::omni_engine<multi_sssp> engine(dc, graph, exec_type);
+
+    for (size_t first = 0; first < sources.size(); first += LANES)
+    {
+        const size_t nlanes = std::min(LANES, sources.size() - first);
+        if (first > 0)
+            graph.transform_vertices(init_vertex);
+        for (size_t k = 0; k < nlanes; ++k)
+        {
+            min_distance_type msg;
+            msg.dist[k] = 0;
+            engine.signal(sources[first + k], msg);
+        }
+        engine.start();
+
+        dc.cout() << "Finished sources " << first << " - " << first + nlanes - 1
+                  << " in " << engine.elapsed_seconds() << " seconds." << std::endl;
+
+        t.start();
+
+        graph.save(output_file + "_" + graphlab::tostr(first / LANES),
+                   multi_sssp_writer(nlanes), false, // set to true if each output file is to be gzipped
+                   true, // whether vertices are saved
+                   false); // whether edges are saved
+        dc.cout() << "Dumping graph in " << t.current_time() << " seconds"
+                  << std::endl;
+    }
+
+    graphlab::mpi_tools::finalize();
+
+}
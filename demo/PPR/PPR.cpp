@@ -0,0 +1,222 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+
+#include <boost/unordered_map.hpp>
+#include <graphlab.hpp>
+#include <cassert>
+
+/*
+ * Batched personalized PageRank: every vertex carries LANES ranks, one per
+ * seed set, and a single engine run over the once-loaded graph computes
+ * a whole batch of seed sets.
+ */
+
+typedef double pagerank_type;
+typedef unsigned long long seed_mask_type;
+
+const size_t LANES = 16;
+int ROUND;
+
+// 1 / |seed set| of every lane in the current batch, 0 for unused lanes
+pagerank_type SEED_WEIGHT[LANES];
+// lanes in which a vertex is a seed, for the current batch
+boost::unordered_map<graphlab::vertex_id_type, seed_mask_type> SEEDS;
+
+struct vertex_data: graphlab::IS_POD_TYPE {
+	pagerank_type pagerank[LANES];
+	seed_mask_type seed_mask;
+	vertex_data() : seed_mask(0) {
+		for (size_t k = 0; k < LANES; ++k)
+			pagerank[k] = 0;
+	}
+};
+
+typedef graphlab::empty edge_data;
+
+typedef graphlab::distributed_graph<vertex_data, edge_data> graph_type;
+
+struct sum_pagerank_type: graphlab::IS_POD_TYPE {
+	pagerank_type pagerank[LANES];
+	sum_pagerank_type() {
+		for (size_t k = 0; k < LANES; ++k)
+			pagerank[k] = 0;
+	}
+	// fixed trip count over contiguous lanes, vectorized by the compiler
+	sum_pagerank_type& operator+=(const sum_pagerank_type& other) {
+		for (size_t k = 0; k < LANES; ++k)
+			pagerank[k] += other.pagerank[k];
+		return *this;
+	}
+};
+
+// gather type is graphlab::empty, then we use message model
+class ppr: public graphlab::ivertex_program<graph_type, graphlab::empty,
+		sum_pagerank_type>, public graphlab::IS_POD_TYPE {
+	sum_pagerank_type sum_pagerank;
+public:
+	void init(icontext_type& context, const vertex_type& vertex,
+			const sum_pagerank_type& msg) {
+		sum_pagerank = msg;
+	}
+
+	edge_dir_type gather_edges(icontext_type& context,
+			const vertex_type& vertex) const {
+		return graphlab::NO_EDGES;
+	}
+
+	void apply(icontext_type& context, vertex_type& vertex,
+			const graphlab::empty& empty) {
+        if (context.iteration() < ROUND)
+        {
+            context.signal(vertex);
+        }
+
+        const seed_mask_type mask = vertex.data().seed_mask;
+        for (size_t k = 0; k < LANES; ++k)
+        {
+            const pagerank_type reset = (mask >> k) & 1 ? 0.15 * SEED_WEIGHT[k] : 0;
+            vertex.data().pagerank[k] = context.iteration() == 0 ?
+                reset / 0.15 : reset + 0.85 * sum_pagerank.pagerank[k];
+        }
+    }
+
+    edge_dir_type scatter_edges(icontext_type& context,
+            const vertex_type& vertex) const {
+        if (context.iteration() < ROUND)
+            return graphlab::OUT_EDGES;
+        else
+            return graphlab::NO_EDGES;
+    }
+
+    // one message per edge carries all lanes
+    void scatter(icontext_type& context, const vertex_type& vertex,
+            edge_type& edge) const {
+        const vertex_type other = edge.target();
+        assert(other.id() != vertex.id());
+        const pagerank_type scale = 1.0 / vertex.num_out_edges();
+        sum_pagerank_type msg;
+        for (size_t k = 0; k < LANES; ++k)
+            msg.pagerank[k] = vertex.data().pagerank[k] * scale;
+        context.signal(other, msg);
+    }
+};
+
+struct ppr_writer {
+    size_t nlanes;
+    ppr_writer(size_t nlanes) : nlanes(nlanes) { }
+    std::string save_vertex(const graph_type::vertex_type& vtx) {
+        std::stringstream strm;
+        strm << vtx.id();
+        for (size_t k = 0; k < nlanes; ++k)
+            strm << "\t" << vtx.data().pagerank[k];
+        strm << "\n";
+        return strm.str();
+    }
+    std::string save_edge(graph_type::edge_type e) {
+        return "";
+    }
+};
+
+bool line_parser(graph_type& graph, const std::string& filename,
+        const std::string& textline) {
+
+    std::istringstream ssin(textline);
+    graphlab::vertex_id_type vid;
+    ssin >> vid;
+    graph.add_vertex(vid);
+    int out_nb;
+    ssin >> out_nb;
+    if(out_nb == 0)
+        graph.add_vertex(vid);
+
+    while (out_nb--) {
+        graphlab::vertex_id_type other_vid;
+        ssin >> other_vid;
+        if(vid != other_vid)
+            graph.add_edge(vid, other_vid);
+    }
+    return true;
+}
+
+// one seed set per line: a whitespace separated list of vertex ids
+std::vector<std::vector<graphlab::vertex_id_type> > load_seed_sets(const std::string& filename) {
+    std::vector<std::vector<graphlab::vertex_id_type> > seed_sets;
+    std::ifstream fin(filename.c_str());
+    std::string textline;
+    while (std::getline(fin, textline)) {
+        std::istringstream ssin(textline);
+        std::vector<graphlab::vertex_id_type> seeds;
+        graphlab::vertex_id_type vid;
+        while (ssin >> vid)
+            seeds.push_back(vid);
+        if (!seeds.empty())
+            seed_sets.push_back(seeds);
+    }
+    return seed_sets;
+}
+
+void init_vertex(graph_type::vertex_type& vertex) {
+    boost::unordered_map<graphlab::vertex_id_type, seed_mask_type>::const_iterator it =
+        SEEDS.find(vertex.id());
+    vertex.data().seed_mask = it == SEEDS.end() ? 0 : it->second;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <input_file> <seed_file> <output_file>" << std::endl;
+        return EXIT_FAILURE;
+    }
+    graphlab::mpi_tools::init(argc, argv);
+
+    char *input_file = argv[1];
+    char *seed_file = argv[2];
+    std::string output_file = argv[3];
+    ROUND = 10;
+    graphlab::distributed_control dc;
+    global_logger().set_log_level(LOG_INFO);
+
+    graphlab::timer t;
+    t.start();
+    graph_type graph(dc);
+    graph.load(input_file, line_parser);
+    graph.finalize();
+
+    dc.cout() << "Loading graph in " << t.current_time() << " seconds" << std::endl;
+    std::string exec_type = "synchronous";
+
+    const std::vector<std::vector<graphlab::vertex_id_type> > seed_sets = load_seed_sets(seed_file);
+    graphlab::omni_engine<ppr> engine(dc, graph, exec_type);
+
+    for (size_t first = 0; first < seed_sets.size(); first += LANES) {
+        const size_t nlanes = std::min(LANES, seed_sets.size() - first);
+        SEEDS.clear();
+        for (size_t k = 0; k < LANES; ++k) {
+            SEED_WEIGHT[k] = 0;
+            if (k >= nlanes)
+                continue;
+            const std::vector<graphlab::vertex_id_type>& seeds = seed_sets[first + k];
+            SEED_WEIGHT[k] = 1.0 / seeds.size();
+            for (size_t i = 0; i < seeds.size(); ++i)
+                SEEDS[seeds[i]] |= seed_mask_type(1) << k;
+        }
+        graph.transform_vertices(init_vertex);
+
+        engine.signal_all();
+        engine.start();
+
+        dc.cout() << "Finished seed sets " << first << " - " << first + nlanes - 1
+            << " in " << engine.elapsed_seconds() << " seconds." << std::endl;
+
+        t.start();
+        graph.save(output_file + "_" + graphlab::tostr(first / LANES), ppr_writer(nlanes),
+                false, // set to true if each output file is to be gzipped
+                true, // whether vertices are saved
+                false); // whether edges are saved
+        dc.cout() << "Dumping graph in " << t.current_time() << " seconds" << std::endl;
+    }
+
+    graphlab::mpi_tools::finalize();
+}
@@ -3,16 +3,24 @@
 #include <fstream>
 
 #include <graphlab.hpp>
+#include "rank_storage.hpp"
 #include <cassert>
+#include <cmath>
 
 typedef double pagerank_type;
 
 const pagerank_type EPS = 0.01;
 int ROUND;
+// push rank changes instead of full ranks and stop once every residual
+// falls below EPS, instead of running exactly ROUND supersteps; the
+// ranks then differ from the ROUND result by up to about EPS per vertex
+bool DELTA_PUSH = false;
 struct vertex_data: graphlab::IS_POD_TYPE {
-	pagerank_type pagerank;
+	stored_rank pagerank;
+	// rank change received but not yet pushed to the out-neighbours
+	pagerank_type residual;
 	vertex_data(pagerank_type pagerank = 1.0) :
-			pagerank(pagerank) {
+			pagerank(pagerank), residual(0) {
 	}
 };
 
@@ -20,7 +28,7 @@ typedef graphlab::empty edge_data;
 
 typedef graphlab::distributed_graph<vertex_data, edge_data> graph_type;
 
-struct sum_pagerank_type: graphlab::IS_POD_TYPE {
+struct sum_pagerank_type {
 	pagerank_type pagerank;
 	sum_pagerank_type(pagerank_type pagerank = 0) :
 		pagerank(pagerank) {
@@ -29,14 +37,21 @@ struct sum_pagerank_type: graphlab::IS_POD_TYPE {
 		pagerank += other.pagerank;
 		return *this;
 	}
+	void save(graphlab::oarchive& oarc) const {
+		save_rank(oarc, pagerank);
+	}
+	void load(graphlab::iarchive& iarc) {
+		load_rank(iarc, pagerank);
+	}
 };
 
 // gather type is graphlab::empty, then we use message model
 class pagerank: public graphlab::ivertex_program<graph_type, graphlab::empty,
 		sum_pagerank_type>, public graphlab::IS_POD_TYPE {
 	pagerank_type sum_pagerank;
+	pagerank_type delta;
 public:
-    pagerank(): sum_pagerank(0){}
+    pagerank(): sum_pagerank(0), delta(0){}
 	void init(icontext_type& context, const vertex_type& vertex,
 			const sum_pagerank_type& msg) {
 		sum_pagerank = msg.pagerank;
@@ -49,6 +64,32 @@ public:
 
 	void apply(icontext_type& context, vertex_type& vertex,
 			const graphlab::empty& empty) {
+        if (DELTA_PUSH)
+        {
+            // every vertex starts from the teleport term, afterwards the
+            // messages already hold the damped change of the in-neighbours
+            pagerank_type change;
+            if (context.iteration() == 0)
+            {
+                change = 0.15;
+                vertex.data().pagerank = change;
+            }
+            else
+            {
+                change = sum_pagerank;
+                vertex.data().pagerank += change;
+            }
+            // small changes accumulate until they are worth a push
+            vertex.data().residual += change;
+            delta = 0;
+            if (std::fabs(vertex.data().residual) > EPS)
+            {
+                delta = vertex.data().residual;
+                vertex.data().residual = 0;
+            }
+            return;
+        }
+
         if (context.iteration() < ROUND)
         {
             context.signal(vertex);
@@ -67,6 +108,8 @@ public:
 
     edge_dir_type scatter_edges(icontext_type& context,
             const vertex_type& vertex) const {
+        if (DELTA_PUSH)
+            return delta != 0 ? graphlab::OUT_EDGES : graphlab::NO_EDGES;
         if (context.iteration() < ROUND)
             return graphlab::OUT_EDGES;
         else
@@ -76,7 +119,9 @@ public:
     void scatter(icontext_type& context, const vertex_type& vertex,
             edge_type& edge) const {
         const vertex_type other = edge.target();
-        pagerank_type value = vertex.data().pagerank / vertex.num_out_edges();
+        pagerank_type value = DELTA_PUSH ?
+            0.85 * delta / vertex.num_out_edges() :
+            vertex.data().pagerank / vertex.num_out_edges();
         assert(other.id() != vertex.id());
         const sum_pagerank_type msg(value);
         context.signal(other, msg);
@@ -0,0 +1,115 @@
+#ifndef RANK_STORAGE_HPP
+#define RANK_STORAGE_HPP
+
+#include <cmath>
+#include <limits>
+#include <boost/cstdint.hpp>
+#include <graphlab.hpp>
+
+/*
+ * Compile-time choice of how ranks are kept in vertex data and encoded in
+ * messages. Compile with -DRANK_STORAGE=RANK_FLOAT or -DRANK_STORAGE=RANK_FIXED
+ * to halve the per-vertex and per-message rank size; arithmetic and
+ * message combining always happen in double. Fixed point only applies to
+ * stored ranks: messages of a RANK_FIXED build travel as float.
+ */
+#define RANK_DOUBLE 0
+#define RANK_FLOAT 1
+#define RANK_FIXED 2
+
+#ifndef RANK_STORAGE
+#define RANK_STORAGE RANK_DOUBLE
+#endif
+
+// fractional bits of the fixed point encoding: resolution 2^-12, range +-2^19
+#ifndef RANK_FIXED_FRAC_BITS
+#define RANK_FIXED_FRAC_BITS 12
+#endif
+
+template <int Storage>
+struct rank_codec;
+
+template <>
+struct rank_codec<RANK_DOUBLE> {
+    typedef double encoded_type;
+    static const char* name() { return "double"; }
+    static encoded_type encode(double value) { return value; }
+    static double decode(encoded_type value) { return value; }
+};
+
+template <>
+struct rank_codec<RANK_FLOAT> {
+    typedef float encoded_type;
+    static const char* name() { return "float32"; }
+    static encoded_type encode(double value) { return static_cast<float>(value); }
+    static double decode(encoded_type value) { return value; }
+};
+
+template <>
+struct rank_codec<RANK_FIXED> {
+    typedef boost::int32_t encoded_type;
+    static const char* name() { return "fixed32"; }
+    static encoded_type encode(double value) {
+        const double scaled = std::floor(value * (1 << RANK_FIXED_FRAC_BITS) + 0.5);
+        // saturate instead of wrapping around
+        if (scaled >= std::numeric_limits<encoded_type>::max())
+            return std::numeric_limits<encoded_type>::max();
+        if (scaled <= std::numeric_limits<encoded_type>::min())
+            return std::numeric_limits<encoded_type>::min();
+        return static_cast<encoded_type>(scaled);
+    }
+    static double decode(encoded_type value) {
+        return value / double(1 << RANK_FIXED_FRAC_BITS);
+    }
+};
+
+/*
+ * A rank held in its encoded form. It reads and writes like a double, so
+ * vertex data can swap its double field for a stored_rank without
+ * touching the vertex programs.
+ */
+template <int Storage>
+struct basic_stored_rank {
+    typedef rank_codec<Storage> codec_type;
+    typename codec_type::encoded_type value;
+
+    basic_stored_rank(double rank = 0) : value(codec_type::encode(rank)) { }
+    operator double() const { return codec_type::decode(value); }
+    basic_stored_rank& operator=(double rank) {
+        value = codec_type::encode(rank);
+        return *this;
+    }
+    basic_stored_rank& operator+=(double rank) {
+        return *this = double(*this) + rank;
+    }
+};
+
+typedef basic_stored_rank<RANK_STORAGE> stored_rank;
+
+/*
+ * Encoding of messages. A per-edge share rank / outdeg (or a damped delta
+ * / outdeg) of a hub is far below the 2^-RANK_FIXED_FRAC_BITS resolution
+ * and would round to zero, so fixed point falls back to float here.
+ */
+template <int Storage>
+struct message_codec {
+    typedef rank_codec<Storage> type;
+};
+
+template <>
+struct message_codec<RANK_FIXED> {
+    typedef rank_codec<RANK_FLOAT> type;
+};
+
+// message payload: summed in double, encoded only on the wire
+inline void save_rank(graphlab::oarchive& oarc, double rank) {
+    oarc << message_codec<RANK_STORAGE>::type::encode(rank);
+}
+
+inline void load_rank(graphlab::iarchive& iarc, double& rank) {
+    message_codec<RANK_STORAGE>::type::encoded_type value;
+    iarc >> value;
+    rank = message_codec<RANK_STORAGE>::type::decode(value);
+}
+
+#endif
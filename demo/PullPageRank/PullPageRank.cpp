@@ -0,0 +1,213 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+
+#include <boost/unordered_map.hpp>
+#include <graphlab.hpp>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/*
+ * Shared-memory pull PageRank for single-node runs.
+ *
+ * The adjacency input is turned into an incoming-edge (CSC) layout and
+ * each superstep gathers the precomputed rank / out-degree contributions
+ * of the in-neighbours from one contiguous array. The sources are split
+ * into segments whose contribution slice fits in L2, so the random reads
+ * of a segment all hit cache; the destinations of a segment are then
+ * processed in parallel and the partial sums are added up per vertex.
+ * The parallel loops need OpenMP and the vectorized gather -mavx2; the
+ * CMakeLists.txt adds both when the compiler supports them.
+ */
+
+typedef double pagerank_type;
+typedef unsigned int local_id_type;
+
+const pagerank_type EPS = 0.01;
+// bytes of contributions read randomly by one segment
+const size_t L2_BYTES = 256 * 1024;
+const size_t SEGMENT_SIZE = L2_BYTES / sizeof(pagerank_type);
+
+// the in-edges of all destinations whose sources fall into one segment
+struct segment_type {
+    std::vector<local_id_type> dst;
+    std::vector<size_t> offset;
+    std::vector<local_id_type> src;
+};
+
+struct csc_graph {
+    std::vector<graphlab::vertex_id_type> vids;
+    std::vector<size_t> out_degree;
+    std::vector<segment_type> segments;
+
+    size_t num_vertices() const { return vids.size(); }
+};
+
+local_id_type local_id(csc_graph& graph,
+                       boost::unordered_map<graphlab::vertex_id_type, local_id_type>& ids,
+                       graphlab::vertex_id_type vid)
+{
+    boost::unordered_map<graphlab::vertex_id_type, local_id_type>::iterator it = ids.find(vid);
+    if (it != ids.end())
+        return it->second;
+    const local_id_type lid = graph.vids.size();
+    ids[vid] = lid;
+    graph.vids.push_back(vid);
+    graph.out_degree.push_back(0);
+    return lid;
+}
+
+// same input format and self-loop handling as the line_parser of PageRank
+void load_csc(const std::string& filename, csc_graph& graph)
+{
+    boost::unordered_map<graphlab::vertex_id_type, local_id_type> ids;
+    std::vector<std::pair<local_id_type, local_id_type> > edges;
+    std::ifstream fin(filename.c_str());
+    std::string textline;
+    while (std::getline(fin, textline)) {
+        std::istringstream ssin(textline);
+        graphlab::vertex_id_type vid;
+        if (!(ssin >> vid))
+            continue;
+        const local_id_type source = local_id(graph, ids, vid);
+        int out_nb;
+        ssin >> out_nb;
+        while (out_nb--) {
+            graphlab::vertex_id_type other_vid;
+            ssin >> other_vid;
+            if (vid != other_vid) {
+                edges.push_back(std::make_pair(source, local_id(graph, ids, other_vid)));
+                ++graph.out_degree[source];
+            }
+        }
+    }
+
+    // bucket the edges by source segment, then sort every bucket by
+    // destination so that each destination owns one contiguous run
+    const size_t nsegments = graph.num_vertices() / SEGMENT_SIZE + 1;
+    std::vector<std::vector<std::pair<local_id_type, local_id_type> > > buckets(nsegments);
+    for (size_t i = 0; i < edges.size(); ++i) {
+        buckets[edges[i].first / SEGMENT_SIZE].push_back(
+            std::make_pair(edges[i].second, edges[i].first));
+    }
+    std::vector<std::pair<local_id_type, local_id_type> >().swap(edges);
+
+    graph.segments.resize(nsegments);
+    for (size_t b = 0; b < nsegments; ++b) {
+        std::sort(buckets[b].begin(), buckets[b].end());
+        segment_type& seg = graph.segments[b];
+        seg.src.reserve(buckets[b].size());
+        for (size_t i = 0; i < buckets[b].size(); ++i) {
+            if (seg.dst.empty() || seg.dst.back() != buckets[b][i].first) {
+                seg.dst.push_back(buckets[b][i].first);
+                seg.offset.push_back(seg.src.size());
+            }
+            seg.src.push_back(buckets[b][i].second);
+        }
+        seg.offset.push_back(seg.src.size());
+        std::vector<std::pair<local_id_type, local_id_type> >().swap(buckets[b]);
+    }
+}
+
+// sum of contrib[src[begin..end)]
+inline pagerank_type gather_sum(const pagerank_type* contrib,
+                                const local_id_type* src,
+                                size_t begin, size_t end)
+{
+    pagerank_type sum = 0;
+    size_t i = begin;
+#ifdef __AVX2__
+    __m256d acc = _mm256_setzero_pd();
+    for (; i + 4 <= end; i += 4) {
+        const __m128i idx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        acc = _mm256_add_pd(acc, _mm256_i32gather_pd(contrib, idx, sizeof(pagerank_type)));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+    for (; i < end; ++i)
+        sum += contrib[src[i]];
+    return sum;
+}
+
+// runs pull supersteps until no vertex changes by more than EPS
+size_t run_pagerank(const csc_graph& graph, std::vector<pagerank_type>& rank)
+{
+    const long n = graph.num_vertices();
+    std::vector<pagerank_type> contrib(n);
+    std::vector<pagerank_type> sum(n);
+    rank.assign(n, 1.0);
+
+    size_t iteration = 0;
+    bool converged = false;
+    while (!converged) {
+        ++iteration;
+#pragma omp parallel for
+        for (long v = 0; v < n; ++v) {
+            contrib[v] = graph.out_degree[v] == 0 ? 0 : rank[v] / graph.out_degree[v];
+            sum[v] = 0;
+        }
+
+        for (size_t b = 0; b < graph.segments.size(); ++b) {
+            const segment_type& seg = graph.segments[b];
+            const long ndst = seg.dst.size();
+#pragma omp parallel for schedule(dynamic, 1024)
+            for (long d = 0; d < ndst; ++d) {
+                sum[seg.dst[d]] += gather_sum(&contrib[0], &seg.src[0],
+                                              seg.offset[d], seg.offset[d + 1]);
+            }
+        }
+
+        converged = true;
+#pragma omp parallel for reduction(&&:converged)
+        for (long v = 0; v < n; ++v) {
+            const pagerank_type new_pagerank = 0.15 + 0.85 * sum[v];
+            converged = converged && std::fabs(rank[v] - new_pagerank) <= EPS;
+            rank[v] = new_pagerank;
+        }
+    }
+    return iteration;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <input_file> <output_file>" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::string input_file = argv[1];
+    std::string output_file = argv[2];
+
+    graphlab::timer t;
+    t.start();
+    csc_graph graph;
+    load_csc(input_file, graph);
+    std::cout << "Loading graph in " << t.current_time() << " seconds" << std::endl;
+
+    t.start();
+    std::vector<pagerank_type> rank;
+    const size_t iterations = run_pagerank(graph, rank);
+    std::cout << "Finished Running engine in " << t.current_time()
+              << " seconds after " << iterations << " iterations." << std::endl;
+
+    double total_rank = 0;
+    for (size_t v = 0; v < rank.size(); ++v)
+        total_rank += rank[v];
+    std::cout << "Total rank: " << total_rank << std::endl;
+
+    // same lines as pagerank_writer
+    t.start();
+    std::ofstream fout(output_file.c_str());
+    for (size_t v = 0; v < rank.size(); ++v)
+        fout << graph.vids[v] << "\t" << rank[v] << "\n";
+    std::cout << "Dumping graph in " << t.current_time() << " seconds" << std::endl;
+
+    return 0;
+}
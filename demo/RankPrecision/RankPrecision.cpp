@@ -0,0 +1,197 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <cstdlib>
+
+#include <boost/unordered_map.hpp>
+#include <graphlab.hpp>
+#include "../PageRank/rank_storage.hpp"
+
+/*
+ * Benchmark for the RANK_STORAGE encodings of PageRank and DynPageRank.
+ *
+ * Runs PageRank on one machine once per encoding, storing ranks and
+ * passing every per-edge message through the message encoding exactly as
+ * the distributed run does, and reports the memory and wire bytes next to
+ * the L1 rank error against the double baseline. Both the ROUND mode and
+ * the DELTA_PUSH mode of PageRank are measured.
+ */
+
+typedef unsigned int local_id_type;
+
+const int ROUND = 10;
+// push threshold of the DELTA_PUSH mode
+const double EPS = 0.01;
+
+struct adj_graph {
+    std::vector<size_t> offset;
+    std::vector<local_id_type> target;
+};
+
+local_id_type local_id(boost::unordered_map<graphlab::vertex_id_type, local_id_type>& ids,
+                       graphlab::vertex_id_type vid)
+{
+    boost::unordered_map<graphlab::vertex_id_type, local_id_type>::iterator it = ids.find(vid);
+    if (it != ids.end())
+        return it->second;
+    const local_id_type lid = ids.size();
+    ids[vid] = lid;
+    return lid;
+}
+
+// same input format and self-loop handling as the line_parser of PageRank
+void load_graph(const std::string& filename, adj_graph& graph)
+{
+    boost::unordered_map<graphlab::vertex_id_type, local_id_type> ids;
+    std::vector<std::vector<local_id_type> > out;
+    std::ifstream fin(filename.c_str());
+    std::string textline;
+    while (std::getline(fin, textline)) {
+        std::istringstream ssin(textline);
+        graphlab::vertex_id_type vid;
+        if (!(ssin >> vid))
+            continue;
+        const local_id_type source = local_id(ids, vid);
+        int out_nb;
+        ssin >> out_nb;
+        while (out_nb--) {
+            graphlab::vertex_id_type other_vid;
+            ssin >> other_vid;
+            if (vid != other_vid) {
+                const local_id_type target = local_id(ids, other_vid);
+                if (out.size() <= std::max(source, target))
+                    out.resize(std::max(source, target) + 1);
+                out[source].push_back(target);
+            }
+        }
+    }
+    out.resize(ids.size());
+    graph.offset.push_back(0);
+    for (size_t v = 0; v < out.size(); ++v) {
+        graph.target.insert(graph.target.end(), out[v].begin(), out[v].end());
+        graph.offset.push_back(graph.target.size());
+    }
+}
+
+template <int Storage>
+std::vector<double> run_pagerank(const adj_graph& graph, size_t& messages)
+{
+    typedef typename message_codec<Storage>::type codec_type;
+    const size_t n = graph.offset.size() - 1;
+    std::vector<basic_stored_rank<Storage> > rank(n, basic_stored_rank<Storage>(1.0));
+    std::vector<double> sum(n);
+    messages = 0;
+    for (int iteration = 1; iteration <= ROUND; ++iteration) {
+        std::fill(sum.begin(), sum.end(), 0.0);
+        for (size_t v = 0; v < n; ++v) {
+            const size_t degree = graph.offset[v + 1] - graph.offset[v];
+            if (degree == 0)
+                continue;
+            // what the receiving machine decodes and then sums in double
+            const double msg = codec_type::decode(codec_type::encode(rank[v] / degree));
+            for (size_t i = graph.offset[v]; i < graph.offset[v + 1]; ++i)
+                sum[graph.target[i]] += msg;
+            messages += degree;
+        }
+        for (size_t v = 0; v < n; ++v)
+            rank[v] = 0.15 + 0.85 * sum[v];
+    }
+    return std::vector<double>(rank.begin(), rank.end());
+}
+
+// the DELTA_PUSH mode: residuals accumulate and are pushed above EPS
+template <int Storage>
+std::vector<double> run_delta_pagerank(const adj_graph& graph, size_t& messages)
+{
+    typedef typename message_codec<Storage>::type codec_type;
+    const size_t n = graph.offset.size() - 1;
+    std::vector<basic_stored_rank<Storage> > rank(n, basic_stored_rank<Storage>(0.15));
+    std::vector<double> residual(n, 0.15);
+    std::vector<double> sum(n);
+    messages = 0;
+    bool pushed = true;
+    while (pushed) {
+        pushed = false;
+        std::fill(sum.begin(), sum.end(), 0.0);
+        for (size_t v = 0; v < n; ++v) {
+            if (std::fabs(residual[v]) <= EPS)
+                continue;
+            const size_t degree = graph.offset[v + 1] - graph.offset[v];
+            if (degree > 0) {
+                const double msg = codec_type::decode(
+                    codec_type::encode(0.85 * residual[v] / degree));
+                for (size_t i = graph.offset[v]; i < graph.offset[v + 1]; ++i)
+                    sum[graph.target[i]] += msg;
+                messages += degree;
+            }
+            residual[v] = 0;
+            pushed = true;
+        }
+        for (size_t v = 0; v < n; ++v) {
+            if (sum[v] == 0)
+                continue;
+            rank[v] += sum[v];
+            residual[v] += sum[v];
+        }
+    }
+    return std::vector<double>(rank.begin(), rank.end());
+}
+
+template <int Storage>
+void report(const adj_graph& graph, const std::vector<double>& baseline, bool delta)
+{
+    typedef rank_codec<Storage> codec_type;
+    typedef typename message_codec<Storage>::type message_type;
+    graphlab::timer t;
+    t.start();
+    size_t messages = 0;
+    const std::vector<double> rank = delta ?
+        run_delta_pagerank<Storage>(graph, messages) :
+        run_pagerank<Storage>(graph, messages);
+    const double seconds = t.current_time();
+
+    double l1 = 0, total = 0;
+    for (size_t v = 0; v < rank.size(); ++v) {
+        l1 += std::fabs(rank[v] - baseline[v]);
+        total += baseline[v];
+    }
+    // only the rank field; vertex data of DynPageRank also carries a residual
+    const size_t rank_bytes = sizeof(typename codec_type::encoded_type);
+    const size_t message_bytes = sizeof(typename message_type::encoded_type);
+    std::cout << (delta ? "delta " : "round ") << codec_type::name() << ": "
+              << rank_bytes * rank.size() << " rank field bytes, "
+              << message_bytes * messages << " message bytes, "
+              << "L1 error " << l1 << " (" << l1 / total << " relative), "
+              << seconds << " seconds" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <input_file>" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::string input_file = argv[1];
+
+    graphlab::timer t;
+    t.start();
+    adj_graph graph;
+    load_graph(input_file, graph);
+    std::cout << "Loading graph in " << t.current_time() << " seconds" << std::endl;
+
+    // message bytes assume one message per edge and push, i.e. no combining
+    size_t messages;
+    for (int delta = 0; delta <= 1; ++delta) {
+        const std::vector<double> baseline = delta ?
+            run_delta_pagerank<RANK_DOUBLE>(graph, messages) :
+            run_pagerank<RANK_DOUBLE>(graph, messages);
+        report<RANK_DOUBLE>(graph, baseline, delta);
+        report<RANK_FLOAT>(graph, baseline, delta);
+        report<RANK_FIXED>(graph, baseline, delta);
+    }
+
+    return 0;
+}
@@ -1,21 +1,49 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <cstdlib>
 
 #include <graphlab.hpp>
 
 typedef double distance_type;
 const int SOURCE = 0;
 
+/*
+ * Delta-stepping: vertices are settled bucket by bucket, bucket b holding
+ * the distances in [b * DELTA, (b + 1) * DELTA). Light edges (dist <= DELTA)
+ * are relaxed while the current bucket keeps changing, heavy edges once it
+ * is done. Every bucket is one light and one heavy engine run: run_engine
+ * activates the pending vertices of CURRENT_BUCKET and moves on to the
+ * smallest pending bucket once the engine drains.
+ */
+bool DELTA_STEPPING = false;
+// run plain Bellman-Ford and delta-stepping one after the other and compare
+bool BENCH_DELTA_STEPPING = false;
+// bucket width, the mean edge weight unless given on the command line
+distance_type DELTA = 0;
+size_t CURRENT_BUCKET = 0;
+bool HEAVY_PHASE = false;
+graphlab::atomic<size_t> RELAXATIONS;
+
+enum relax_type { RELAX_NONE, RELAX_ALL, RELAX_LIGHT, RELAX_HEAVY };
+
 struct vertex_data: graphlab::IS_POD_TYPE
 {
     distance_type dist;
+    // edges still to relax since the last improvement of dist
+    bool light_pending;
+    bool heavy_pending;
     vertex_data(distance_type dist = std::numeric_limits<distance_type>::max()) :
-        dist(dist)
+        dist(dist), light_pending(false), heavy_pending(false)
     {
     }
 };
 
+size_t bucket_of(distance_type dist)
+{
+    return static_cast<size_t>(dist / DELTA);
+}
+
 struct edge_data: graphlab::IS_POD_TYPE
 {
     distance_type dist;
@@ -47,6 +75,7 @@ class sssp: public graphlab::ivertex_program<graph_type, graphlab::empty,
 {
     distance_type min_dist;
     bool changed;
+    relax_type relax;
 public:
 
     void init(icontext_type& context, const vertex_type& vertex,
@@ -70,12 +99,37 @@ public:
             changed = true;
             vertex.data().dist = min_dist;
         }
+        if (!DELTA_STEPPING)
+        {
+            relax = changed ? RELAX_ALL : RELAX_NONE;
+            return;
+        }
+
+        vertex_data& data = vertex.data();
+        if (changed)
+            data.light_pending = data.heavy_pending = true;
+        relax = RELAX_NONE;
+        // improvements into the current bucket are relaxed right away,
+        // later buckets wait until run_engine activates them
+        if (bucket_of(data.dist) <= CURRENT_BUCKET)
+        {
+            if (!HEAVY_PHASE && data.light_pending)
+            {
+                relax = RELAX_LIGHT;
+                data.light_pending = false;
+            }
+            else if (HEAVY_PHASE && data.heavy_pending)
+            {
+                relax = RELAX_HEAVY;
+                data.heavy_pending = false;
+            }
+        }
     }
 
     edge_dir_type scatter_edges(icontext_type& context,
                                 const vertex_type& vertex) const
     {
-        if (changed)
+        if (relax != RELAX_NONE)
             return graphlab::OUT_EDGES;
         else
             return graphlab::NO_EDGES;
@@ -84,6 +138,11 @@ public:
     void scatter(icontext_type& context, const vertex_type& vertex,
                  edge_type& edge) const
     {
+        const bool light = edge.data().dist <= DELTA;
+        if ((relax == RELAX_LIGHT && !light) || (relax == RELAX_HEAVY && light))
+            return;
+        if (BENCH_DELTA_STEPPING)
+            RELAXATIONS.inc();
         const vertex_type other = edge.target();
         distance_type newd = vertex.data().dist + edge.data().dist;
 
@@ -94,6 +153,60 @@ public:
 
 };
 
+struct min_bucket_type: graphlab::IS_POD_TYPE
+{
+    size_t bucket;
+    min_bucket_type(size_t bucket = std::numeric_limits<size_t>::max()) :
+        bucket(bucket)
+    {
+    }
+    min_bucket_type& operator+=(const min_bucket_type& other)
+    {
+        bucket = std::min(bucket, other.bucket);
+        return *this;
+    }
+};
+
+// smallest bucket that still has a vertex with edges to relax
+min_bucket_type pending_bucket(const graph_type::vertex_type& vertex)
+{
+    const vertex_data& data = vertex.data();
+    if (!data.light_pending && !data.heavy_pending)
+        return min_bucket_type();
+    return min_bucket_type(bucket_of(data.dist));
+}
+
+bool light_in_bucket(const graph_type::vertex_type& vertex)
+{
+    return vertex.data().light_pending && bucket_of(vertex.data().dist) <= CURRENT_BUCKET;
+}
+
+bool heavy_in_bucket(const graph_type::vertex_type& vertex)
+{
+    return vertex.data().heavy_pending && bucket_of(vertex.data().dist) <= CURRENT_BUCKET;
+}
+
+struct weight_sum_type: graphlab::IS_POD_TYPE
+{
+    distance_type sum;
+    size_t count;
+    weight_sum_type(distance_type sum = 0, size_t count = 0) :
+        sum(sum), count(count)
+    {
+    }
+    weight_sum_type& operator+=(const weight_sum_type& other)
+    {
+        sum += other.sum;
+        count += other.count;
+        return *this;
+    }
+};
+
+weight_sum_type edge_weight(const graph_type::edge_type& edge)
+{
+    return weight_sum_type(edge.data().dist, 1);
+}
+
 struct sssp_writer
 {
     std::string save_vertex(const graph_type::vertex_type& vtx)
@@ -135,7 +248,59 @@ bool line_parser(graph_type& graph, const std::string& filename,
 void init_vertex(graph_type::vertex_type& vertex)
 {
 
-    vertex.data().dist = std::numeric_limits<distance_type>::max();
+    vertex.data() = vertex_data();
+}
+
+void run_engine(graphlab::distributed_control& dc, graph_type& graph,
+                const std::string& exec_type, bool delta_stepping)
+{
+    DELTA_STEPPING = delta_stepping;
+    CURRENT_BUCKET = 0;
+    HEAVY_PHASE = false;
+    RELAXATIONS.value = 0;
+
+    graphlab::omni_engine<sssp> engine(dc, graph, exec_type);
+
+    engine.signal(SOURCE, min_distance_type(0));
+    engine.start();
+    double seconds = engine.elapsed_seconds();
+    size_t supersteps = engine.iteration();
+    size_t buckets = 1;
+
+    while (delta_stepping)
+    {
+        HEAVY_PHASE = true;
+        engine.signal_vset(graph.select(heavy_in_bucket));
+        engine.start();
+        seconds += engine.elapsed_seconds();
+        supersteps += engine.iteration();
+
+        const size_t next = graph.map_reduce_vertices<min_bucket_type>(pending_bucket).bucket;
+        if (next == std::numeric_limits<size_t>::max())
+            break;
+        CURRENT_BUCKET = next;
+        HEAVY_PHASE = false;
+        engine.signal_vset(graph.select(light_in_bucket));
+        engine.start();
+        seconds += engine.elapsed_seconds();
+        supersteps += engine.iteration();
+        ++buckets;
+    }
+
+    dc.cout() << "Finished Running engine in " << seconds
+              << " seconds." << std::endl;
+
+    if (BENCH_DELTA_STEPPING)
+    {
+        size_t relaxations = RELAXATIONS.value;
+        dc.all_reduce(relaxations);
+        dc.cout() << (delta_stepping ? "Delta-stepping" : "Bellman-Ford") << ": ";
+        if (delta_stepping)
+            dc.cout() << buckets << " buckets, ";
+        dc.cout() << supersteps << " supersteps, "
+                  << relaxations << " relaxations, "
+                  << seconds << " seconds" << std::endl;
+    }
 }
 
 int main(int argc, char** argv)
@@ -144,6 +309,9 @@ int main(int argc, char** argv)
     char *input_file = "hdfs://master:9000/pullgel/usa";
     char *output_file = "hdfs://master:9000/exp/sssp";
     std::string exec_type = "synchronous";
+    // optional bucket width for delta-stepping
+    if (argc > 1)
+        DELTA = atof(argv[1]);
     graphlab::distributed_control dc;
     global_logger().set_log_level(LOG_INFO);
 
@@ -155,14 +323,24 @@ int main(int argc, char** argv)
     graph.transform_vertices(init_vertex);
     dc.cout() << "Loading graph in " << t.current_time() << " seconds"
               << std::endl;
-    
-    graphlab::omni_engine<sssp> engine(dc, graph, exec_type);
 
-    engine.signal(SOURCE, min_distance_type(0));
-    engine.start();
+    if ((DELTA_STEPPING || BENCH_DELTA_STEPPING) && DELTA <= 0)
+    {
+        const weight_sum_type weights = graph.map_reduce_edges<weight_sum_type>(edge_weight);
+        DELTA = weights.sum > 0 ? weights.sum / weights.count : 1;
+        dc.cout() << "Delta-stepping with bucket width " << DELTA << std::endl;
+    }
 
-    dc.cout() << "Finished Running engine in " << engine.elapsed_seconds()
-              << " seconds." << std::endl;
+    if (BENCH_DELTA_STEPPING)
+    {
+        run_engine(dc, graph, exec_type, false);
+        graph.transform_vertices(init_vertex);
+        run_engine(dc, graph, exec_type, true);
+    }
+    else
+    {
+        run_engine(dc, graph, exec_type, DELTA_STEPPING);
+    }
 
     t.start();
 
@@ -0,0 +1,83 @@
+#ifndef LOCAL_UNION_FIND_HPP
+#define LOCAL_UNION_FIND_HPP
+
+#include <vector>
+#include <limits>
+#include <graphlab.hpp>
+#include <graphlab/macros_def.hpp>
+
+/*
+ * Pre-contraction for connected components: a parallel union-find over
+ * the edges a machine holds gives every local vertex the smallest global
+ * id of its locally connected component. Any such label lies in the
+ * vertex's global component, so starting label propagation from it still
+ * ends at the minimum id of every component, while the components that
+ * live inside one partition are already settled.
+ */
+
+// path halving; parents only move towards smaller lvids
+inline graphlab::lvid_type uf_find(std::vector<graphlab::lvid_type>& parent,
+                                   graphlab::lvid_type x)
+{
+    while (true) {
+        graphlab::lvid_type p = parent[x];
+        if (p == x)
+            return x;
+        graphlab::lvid_type gp = parent[p];
+        if (p != gp)
+            graphlab::atomic_compare_and_swap(parent[x], p, gp);
+        x = gp;
+    }
+}
+
+inline void uf_union(std::vector<graphlab::lvid_type>& parent,
+                     graphlab::lvid_type a, graphlab::lvid_type b)
+{
+    while (true) {
+        a = uf_find(parent, a);
+        b = uf_find(parent, b);
+        if (a == b)
+            return;
+        if (a < b)
+            std::swap(a, b);
+        // link the larger root under the smaller one, retry if a lost a race
+        if (graphlab::atomic_compare_and_swap(parent[a], a, b))
+            return;
+    }
+}
+
+// label of every local vertex (masters and mirrors), indexed by lvid
+template <typename Graph>
+std::vector<graphlab::vertex_id_type> local_component_labels(Graph& graph)
+{
+    typedef typename Graph::local_vertex_type local_vertex_type;
+    typedef typename Graph::local_edge_type local_edge_type;
+    const long n = graph.num_local_vertices();
+
+    std::vector<graphlab::lvid_type> parent(n);
+    for (long lvid = 0; lvid < n; ++lvid)
+        parent[lvid] = lvid;
+
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (long lvid = 0; lvid < n; ++lvid) {
+        local_vertex_type lvertex = graph.l_vertex(lvid);
+        foreach(local_edge_type edge, lvertex.out_edges()) {
+            uf_union(parent, lvid, edge.target().id());
+        }
+    }
+
+    std::vector<graphlab::vertex_id_type> root_label(n,
+        std::numeric_limits<graphlab::vertex_id_type>::max());
+    for (long lvid = 0; lvid < n; ++lvid) {
+        const graphlab::lvid_type root = uf_find(parent, lvid);
+        root_label[root] = std::min(root_label[root], graph.l_vertex(lvid).global_id());
+    }
+    std::vector<graphlab::vertex_id_type> label(n);
+    for (long lvid = 0; lvid < n; ++lvid)
+        label[lvid] = root_label[uf_find(parent, lvid)];
+    return label;
+}
+
+#include <graphlab/macros_undef.hpp>
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef PHASE_PIPELINE_HPP
+#define PHASE_PIPELINE_HPP
+
+#include <vector>
+#include <string>
+#include <boost/function.hpp>
+#include <graphlab.hpp>
+
+/*
+ * A sequence of phases run on one engine. Every phase sets the globals
+ * its branch of the vertex program reads, activates its initial set from
+ * the vertex data the previous phase left behind and starts the engine,
+ * as often as it needs; the engine is set up once. A phase that needs an
+ * aggregator registers it itself, so the others do not pay for it.
+ */
+template <typename Engine, typename Graph>
+class phase_pipeline {
+public:
+    typedef Engine engine_type;
+    typedef Graph graph_type;
+    typedef boost::function<void (engine_type&, graph_type&)> phase_function;
+
+    phase_pipeline(graphlab::distributed_control& dc, engine_type& engine,
+                   graph_type& graph)
+        : dc(dc), engine(engine), graph(graph)
+    {
+    }
+
+    void add_phase(const std::string& name, phase_function run)
+    {
+        names.push_back(name);
+        phases.push_back(run);
+    }
+
+    void run()
+    {
+        for (size_t i = 0; i < phases.size(); ++i) {
+            graphlab::timer t;
+            t.start();
+            phases[i](engine, graph);
+            dc.cout() << "Finished phase " << names[i] << " in "
+                      << t.current_time() << " seconds." << std::endl;
+        }
+    }
+
+private:
+    graphlab::distributed_control& dc;
+    engine_type& engine;
+    graph_type& graph;
+    std::vector<std::string> names;
+    std::vector<phase_function> phases;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef VERTEX_BITSET_HPP
+#define VERTEX_BITSET_HPP
+
+#include <graphlab.hpp>
+#include <graphlab/util/dense_bitset.hpp>
+
+/*
+ * A set of the local vertices (lvids) of one machine, one bit each, for
+ * the frontier and visited sets of traversal programs. Vertex programs
+ * set the bits of the masters they run on (set_bit is atomic), the
+ * driver combines sets a word at a time between engine runs and turns
+ * the result into the vertex_set of the next run by walking the set
+ * bits only, so activating a small frontier does not scan the graph.
+ *
+ * Mirrors only learn a change through the vertex data the engine
+ * replicates, so a test inside a superstep has to read vertex data; the
+ * bits are exact once a run has ended.
+ */
+template <typename Graph>
+class vertex_bitset {
+public:
+    typedef Graph graph_type;
+
+    vertex_bitset() { }
+
+    explicit vertex_bitset(const graph_type& graph)
+        : bits(graph.num_local_vertices())
+    {
+        bits.clear();
+    }
+
+    // the masters of this machine
+    static vertex_bitset masters(const graph_type& graph)
+    {
+        vertex_bitset set(graph);
+        for (graphlab::lvid_type lvid = 0; lvid < graph.num_local_vertices(); ++lvid)
+            if (graph.l_is_master(lvid))
+                set.bits.set_bit_unsync(lvid);
+        return set;
+    }
+
+    void set(graphlab::lvid_type lvid) { bits.set_bit(lvid); }
+    bool test(graphlab::lvid_type lvid) const { return bits.get(lvid); }
+    void clear() { bits.clear(); }
+
+    vertex_bitset& operator-=(const vertex_bitset& other)
+    {
+        bits -= other.bits;
+        return *this;
+    }
+    vertex_bitset operator-(const vertex_bitset& other) const
+    {
+        vertex_bitset result(*this);
+        result -= other;
+        return result;
+    }
+
+    // members on all machines; every machine has to call it
+    size_t global_count(graphlab::distributed_control& dc) const
+    {
+        size_t count = bits.popcount();
+        dc.all_reduce(count);
+        return count;
+    }
+
+    graphlab::vertex_set to_vertex_set(const graph_type& graph) const
+    {
+        graphlab::vertex_set vset(false);
+        vset.make_explicit(graph);
+        size_t lvid;
+        if (bits.first_bit(lvid)) {
+            do {
+                vset.set_lvid_unsync(lvid);
+            } while (bits.next_bit(lvid));
+        }
+        return vset;
+    }
+
+private:
+    graphlab::dense_bitset bits;
+};
+
+#endif